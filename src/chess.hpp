@@ -2026,6 +2026,52 @@ class Board {
             enpassant(enpassant),
             half_moves(half_moves),
             captured_piece(captured_piece) {}
+        State() = default;
+    };
+
+    // History of the states before each move, in a fixed ring: making a move
+    // never allocates and copying a Board only copies the states in use. Only
+    // the last CAPACITY states are kept. That covers the repetition search,
+    // which never looks back further than the half-move clock (at most 255),
+    // plus every move a search can unmake; older moves are never unmade.
+    class StateStack {
+       public:
+        static constexpr int CAPACITY = 1024;  // A power of two
+
+        StateStack() = default;
+        StateStack(const StateStack& other) { *this = other; }
+        StateStack& operator=(const StateStack& other) {
+            if (this != &other)
+            {
+                size_ = other.size_;
+                for (int i = std::max(0, size_ - CAPACITY); i < size_; ++i)
+                    (*this)[i] = other[i];
+            }
+            return *this;
+        }
+
+        template<typename... Args>
+        void emplace_back(Args&&... args) {
+            states_[size_++ & (CAPACITY - 1)] = State(std::forward<Args>(args)...);
+        }
+        void pop_back() {
+            assert(size_ > 0);
+            --size_;
+        }
+        const State& back() const { return (*this)[size_ - 1]; }
+        int          size() const { return size_; }
+        void         clear() { size_ = 0; }
+
+        // i counts from the first move ever made, only the last CAPACITY are valid
+        State&       operator[](int i) { return states_[i & (CAPACITY - 1)]; }
+        const State& operator[](int i) const {
+            assert(i >= size_ - CAPACITY);
+            return states_[i & (CAPACITY - 1)];
+        }
+
+       private:
+        std::array<State, CAPACITY> states_;
+        int                         size_ = 0;
     };
 
     enum class PrivateCtor {
@@ -2037,7 +2083,6 @@ class Board {
 
    public:
     explicit Board(std::string_view fen = constants::STARTPOS, bool chess960 = false) {
-        prev_states_.reserve(256);
         chess960_ = chess960;
         assert(setFenInternal<true>(constants::STARTPOS));
         setFenInternal<true>(fen);
@@ -2676,10 +2721,11 @@ class Board {
 
         // We start the loop from the back and go forward in moves, at most to the
         // last move which reset the half-move counter because repetitions cant
-        // be across half-moves.
+        // be across half-moves. Only positions with the same side to move can be
+        // equal, and not the one two plies ago (each side made one move).
         const auto size = static_cast<int>(prev_states_.size());
 
-        for (int i = size - 2; i >= 0 && i >= size - hfm_ - 1; i -= 2)
+        for (int i = size - 4; i >= 0 && i >= size - hfm_; i -= 2)
         {
             if (prev_states_[i].hash == key_)
                 c++;
@@ -2690,6 +2736,52 @@ class Board {
         return false;
     }
 
+    /**
+     * @brief Checks if the side to move has a reversible move that reaches a
+     * position of the last plies again, i.e. can force a repetition, without
+     * generating moves (Marcel van Kervinck's cuckoo tables, as in Stockfish).
+     * Only cycles within the last `ply` plies (the search tree) are reported.
+     * @param ply plies since the root of the search
+     * @return
+     */
+    [[nodiscard]] bool hasUpcomingRepetition(int ply) const noexcept {
+        const auto size = static_cast<int>(prev_states_.size());
+        const int  end  = std::min({static_cast<int>(hfm_), ply, size});
+
+        if (end < 3) return false;
+
+        const auto& table = cuckoo();
+        const U64   side  = Zobrist::sideToMove();
+
+        // other is zero when the opponent's moves since i plies ago cancel out
+        U64 other = key_ ^ prev_states_[size - 1].hash ^ side;
+
+        for (int i = 3; i <= end; i += 2)
+        {
+            other ^= prev_states_[size - i + 1].hash ^ prev_states_[size - i].hash ^ side;
+            if (other != 0) continue;
+
+            const U64 moveKey = key_ ^ prev_states_[size - i].hash;
+            int       j       = Cuckoo::h1(moveKey);
+
+            if (table.keys[j] != moveKey)
+            {
+                j = Cuckoo::h2(moveKey);
+                if (table.keys[j] != moveKey) continue;
+            }
+
+            // The squares between from and to must be empty
+            const Square    from = table.moves[j].from();
+            const Square    to   = table.moves[j].to();
+            const PieceType pt   = table.types[j];
+            if (pt == PieceType::KNIGHT || pt == PieceType::KING
+                || (attacks::queen(from, occ()) & Bitboard::fromSquare(to)))
+                return true;
+        }
+
+        return false;
+    }
+
     /**
      * @brief Checks if the current position is a draw by 50 move rule.
      * Keep in mind that by the rules of chess, if the position has 50 half
@@ -3199,7 +3291,7 @@ class Board {
 
     virtual void removePiece(Piece piece, Square sq) { removePieceInternal(piece, sq); }
 
-    std::vector<State> prev_states_;
+    StateStack prev_states_;
 
     std::array<Bitboard, 6> pieces_bb_ = {};
     std::array<Bitboard, 2> occ_bb_    = {};
@@ -3217,6 +3309,58 @@ class Board {
     std::array<std::array<Bitboard, 2>, 2> castling_path = {};
 
    private:
+    // Hash of every reversible move (piece, from, to, side) with the move and
+    // the piece type, two hash functions with one slot each.
+    struct Cuckoo {
+        static constexpr int SIZE = 8192;
+
+        static int h1(U64 key) noexcept { return static_cast<int>(key & (SIZE - 1)); }
+        static int h2(U64 key) noexcept { return static_cast<int>((key >> 16) & (SIZE - 1)); }
+
+        std::array<U64, SIZE>       keys  = {};
+        std::array<Move, SIZE>      moves = {};
+        std::array<PieceType, SIZE> types = {};
+    };
+
+    static const Cuckoo &cuckoo() {
+        static const Cuckoo table = [] {
+            Cuckoo t;
+            for (auto c : {Color::WHITE, Color::BLACK})
+                for (auto pt : {PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK, PieceType::QUEEN,
+                                PieceType::KING})
+                {
+                    const Piece pc(pt, c);
+                    for (int s1 = 0; s1 < 64; ++s1)
+                        for (int s2 = s1 + 1; s2 < 64; ++s2)
+                        {
+                            Bitboard reach = pt == PieceType::KNIGHT ? attacks::knight(Square(s1))
+                                           : pt == PieceType::BISHOP ? attacks::bishop(Square(s1), Bitboard(0))
+                                           : pt == PieceType::ROOK   ? attacks::rook(Square(s1), Bitboard(0))
+                                           : pt == PieceType::QUEEN  ? attacks::queen(Square(s1), Bitboard(0))
+                                                                     : attacks::king(Square(s1));
+                            if (!(reach & Bitboard::fromSquare(s2))) continue;
+
+                            U64       key = Zobrist::piece(pc, Square(s1)) ^ Zobrist::piece(pc, Square(s2))
+                                  ^ Zobrist::sideToMove();
+                            Move      mv  = Move::make(Square(s1), Square(s2));
+                            PieceType ty  = pt;
+                            int       i   = Cuckoo::h1(key);
+                            // Kick out the occupant until an empty slot is found
+                            while (true)
+                            {
+                                std::swap(t.keys[i], key);
+                                std::swap(t.moves[i], mv);
+                                std::swap(t.types[i], ty);
+                                if (key == 0) break;
+                                i = (i == Cuckoo::h1(key)) ? Cuckoo::h2(key) : Cuckoo::h1(key);
+                            }
+                        }
+                }
+            return t;
+        }();
+        return table;
+    }
+
     void removePieceInternal(Piece piece, Square sq) {
         assert(board_[sq.index()] == piece && piece != Piece::NONE);
 
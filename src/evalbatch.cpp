@@ -0,0 +1,200 @@
+#include "evalbatch.hpp"
+#include "chess.hpp"
+#include "evaluate.h"
+#include "numa.hpp"
+#include "nnue/nnue_accumulator.h"
+#include "nnue/nnue_backend.h"
+#include "position.h"
+#include "search.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+
+namespace evalbatch {
+namespace {
+
+// Boards per call of Eval::evaluate_batch(), a board is about 25 KB. The more
+// positions, the more of them share the king squares.
+constexpr size_t CHUNK_SIZE = 1024;
+
+// Passes over the positions in bench()
+constexpr int BENCH_PASSES = 50;
+
+using Stockfish::Value;
+
+void print_speed(std::ostream& out, const char* label, uint64_t positions, double seconds) {
+    out << label << static_cast<uint64_t>(positions / std::max(seconds, 1e-6)) << "\n";
+}
+
+// The given positions and all the positions one move away from them, shuffled
+std::vector<chess::Board> bench_positions(const std::vector<std::string>& fens) {
+    std::vector<chess::Board> boards;
+    for (const auto& fen : fens)
+    {
+        chess::Board board(fen);
+        boards.push_back(board);
+
+        chess::Movelist moves;
+        chess::movegen::legalmoves(moves, board);
+        for (const auto& mv : moves)
+        {
+            board.makeMove(mv);
+            boards.push_back(board);
+            board.unmakeMove(mv);
+        }
+    }
+
+    // Labeling data is usually shuffled, consecutive positions are unrelated.
+    // A fixed seed keeps the work the same from run to run.
+    std::mt19937 rng(20250101);
+    for (size_t i = boards.size() - 1; i > 0; --i)
+        std::swap(boards[i], boards[rng() % (i + 1)]);
+    return boards;
+}
+}  // namespace
+
+uint64_t run(std::istream& in, std::ostream& out) {
+    auto start  = std::chrono::steady_clock::now();
+    auto caches = search::nn->new_caches();
+    auto pos    = std::make_unique<Stockfish::Position>(chess::Board());
+
+    std::vector<std::string>  fens;   // In input order, with the invalid ones
+    std::vector<bool>         valid;  // One per fen
+    std::vector<chess::Board> boards;
+    std::vector<Value>        values;
+    uint64_t                  total = 0;
+
+    auto flush = [&] {
+        Stockfish::Eval::evaluate_batch(*search::nn, boards, *pos, *caches, values);
+        for (size_t i = 0, b = 0; i < fens.size(); ++i)
+        {
+            out << fens[i] << ": ";
+            if (!valid[i])
+            {
+                out << "invalid\n";
+                continue;
+            }
+            Value v = values[b++];
+            if (v == Stockfish::VALUE_NONE)
+                out << "none\n";
+            else
+                out << "cp " << v << "\n";
+        }
+        total += boards.size();
+        fens.clear();
+        valid.clear();
+        boards.clear();
+    };
+
+    chess::Board board;
+    std::string  line;
+    while (std::getline(in, line))
+    {
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        fens.push_back(line);
+        valid.push_back(board.setFen(line));
+        if (valid.back())
+            boards.push_back(board);
+        if (fens.size() == CHUNK_SIZE)
+            flush();
+    }
+    flush();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    out << "===========================\n";
+    out << "Total time (ms) : " << static_cast<int>(elapsed.count() * 1000) << "\n";
+    out << "Positions       : " << total << "\n";
+    print_speed(out, "Positions/second: ", total, elapsed.count());
+    out.flush();
+    return total;
+}
+
+void bench(const std::vector<std::string>& fens, std::ostream& out) {
+    const auto boards = bench_positions(fens);
+    auto       caches = search::nn->new_caches();
+
+    // One position at a time, as in the search but without incremental updates
+    auto                      pos = std::make_unique<Stockfish::Position>(chess::Board());
+    std::vector<Value>        single(boards.size(), Stockfish::VALUE_NONE);
+    auto                      start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < BENCH_PASSES; ++pass)
+        for (size_t i = 0; i < boards.size(); ++i)
+        {
+            pos->set(boards[i]);
+            if (!pos->in_check())
+                single[i] = Stockfish::Eval::evaluate(*search::nn, *pos, pos->stack, *caches, 0);
+        }
+    std::chrono::duration<double> singleTime = std::chrono::steady_clock::now() - start;
+
+    std::vector<Value> batched;
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < BENCH_PASSES; ++pass)
+        Stockfish::Eval::evaluate_batch(*search::nn, boards, *pos, *caches, batched);
+    std::chrono::duration<double> batchTime = std::chrono::steady_clock::now() - start;
+
+    uint64_t positions = uint64_t(boards.size()) * BENCH_PASSES;
+    out << "===========================\n";
+    out << "Positions       : " << positions << "\n";
+    print_speed(out, "Single/second   : ", positions, singleTime.count());
+    print_speed(out, "Batched/second  : ", positions, batchTime.count());
+    out << "Same values     : " << (single == batched ? "yes" : "no") << std::endl;
+}
+
+void bench_numa(const std::vector<std::string>& fens, std::ostream& out) {
+    const auto boards = bench_positions(fens);
+    const auto nodes  = numa::nodes();
+    uint64_t   positions = uint64_t(boards.size()) * BENCH_PASSES;
+
+    // The copy of each node, and the speed of the threads of each node with
+    // the copy of each node. Only the diagonal is used by the search.
+    std::vector<std::unique_ptr<Stockfish::Eval::NNUE::Backend>> copies(nodes.size());
+    std::vector<std::vector<double>> speed(nodes.size(), std::vector<double>(nodes.size()));
+
+    for (size_t n = 0; n < nodes.size(); ++n)
+        numa::run_on(nodes[n], [&] { copies[n] = search::nn->replicate(); });
+
+    for (size_t t = 0; t < nodes.size(); ++t)
+        for (size_t n = 0; n < nodes.size(); ++n)
+            numa::run_on(nodes[t], [&] {
+                auto caches = copies[n]->new_caches();
+                auto pos    = std::make_unique<Stockfish::Position>(chess::Board());
+                auto start  = std::chrono::steady_clock::now();
+                for (int pass = 0; pass < BENCH_PASSES; ++pass)
+                    for (const auto& board : boards)
+                    {
+                        pos->set(board);
+                        if (!pos->in_check())
+                            Stockfish::Eval::evaluate(*copies[n], *pos, pos->stack, *caches, 0);
+                    }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                speed[t][n] = positions / std::max(elapsed.count(), 1e-6);
+            });
+
+    double local = 0, remote = 0;
+    out << "===========================\n";
+    out << "Positions/second, threads of a node (rows) with the networks of a node\n";
+    for (size_t t = 0; t < nodes.size(); ++t)
+    {
+        out << "node " << t << ":";
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            out << " " << static_cast<uint64_t>(speed[t][n]);
+            (t == n ? local : remote) += speed[t][n];
+        }
+        out << "\n";
+    }
+    out << "Local           : " << static_cast<uint64_t>(local / nodes.size()) << "\n";
+    if (nodes.size() > 1)
+        out << "Remote          : "
+            << static_cast<uint64_t>(remote / (nodes.size() * (nodes.size() - 1))) << "\n";
+    else
+        out << "Remote          : none, a single NUMA node\n";
+    out.flush();
+}
+}  // namespace evalbatch
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Static evaluation of many unrelated positions, for offline labeling
+// ('evalbatch <file>') and its benchmark ('bench eval'). Uses the networks of
+// the search but not its threads, runs on the calling thread.
+namespace evalbatch {
+
+// Evaluates the FENs read from in, one per line (empty lines and lines
+// starting with '#' are skipped), and prints '<fen>: cp <value>' for each, or
+// '<fen>: none' in check, '<fen>: invalid' when the FEN does not parse. Ends
+// with the positions per second. Returns the number of positions evaluated.
+uint64_t run(std::istream& in, std::ostream& out);
+
+// Evaluates the given positions and all the positions one move away from
+// them, both in batches and one at a time, and prints the positions per
+// second of each. The values must be the same.
+void bench(const std::vector<std::string>& fens, std::ostream& out);
+
+// NUMA: evaluates the same positions one at a time on a thread bound to each
+// node, with a copy of the networks made on each node, and prints the
+// positions per second of every pair. The search only uses the pairs of the
+// same node (see search::set_numa_replication()), the others show what
+// reading the weights across the interconnect costs.
+void bench_numa(const std::vector<std::string>& fens, std::ostream& out);
+}  // namespace evalbatch
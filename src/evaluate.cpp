@@ -22,21 +22,53 @@
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
-#include <iomanip>
-#include <iostream>
-#include <memory>
-#include <sstream>
 #include <tuple>
+#include <vector>
 
-#include "nnue/network.h"
-#include "nnue/nnue_misc.h"
+#include "nnue/nnue_accumulator.h"
+#include "nnue/nnue_backend.h"
 #include "position.h"
 #include "types.h"
-#include "uci.hpp"
-#include "nnue/nnue_accumulator.h"
 
 namespace Stockfish {
 
+namespace {
+
+Value nnue_value(Value psqt, Value positional) { return (125 * psqt + 131 * positional) / 128; }
+
+// Re-evaluate the position when higher eval accuracy is worth the time spent
+bool needs_big_net(Value psqt, Value positional) {
+    return std::abs(nnue_value(psqt, positional)) < 236;
+}
+
+// The evaluation from the output of the net that was used last, material is
+// 535 * pawns + non pawn material
+Value blend(Value psqt, Value positional, int optimism, int material, int rule50) {
+
+    Value nnue = nnue_value(psqt, positional);
+
+    // Blend optimism and eval with nnue complexity
+    int nnueComplexity = std::abs(psqt - positional);
+    optimism += optimism * nnueComplexity / 468;
+    nnue -= nnue * nnueComplexity / 18000;
+
+    int v = (nnue * (77777 + material) + optimism * (7777 + material)) / 77777;
+
+    // Damp down the evaluation linearly when shuffling
+    v -= v * rule50 / 212;
+
+    // Guarantee evaluation does not hit the tablebase range
+    v = std::clamp(v, VALUE_TB_LOSS_IN_MAX_PLY + 1, VALUE_TB_WIN_IN_MAX_PLY - 1);
+
+    return v;
+}
+
+int blend_material(const Position& pos) {
+    return 535 * pos.count<PAWN>() + pos.non_pawn_material();
+}
+
+}  // namespace
+
 // Returns a static, purely materialistic evaluation of the position from
 // the point of view of the side to move. It can be divided by PawnValue to get
 // an approximation of the material advantage on the board in terms of pawns.
@@ -50,75 +82,93 @@ bool Eval::use_smallnet(const Position& pos) { return std::abs(simple_eval(pos))
 
 // Evaluate is the evaluator for the outer world. It returns a static evaluation
 // of the position from the point of view of the side to move.
-Value Eval::evaluate(const Eval::NNUE::Networks&    networks,
+Value Eval::evaluate(const Eval::NNUE::Backend&     networks,
                      const Position&                pos,
                      Eval::NNUE::AccumulatorStack&  accumulators,
                      Eval::NNUE::AccumulatorCaches& caches,
                      int                            optimism) {
 
-    assert(!pos.b.inCheck());
+    assert(!pos.in_check());
 
     bool smallNet           = use_smallnet(pos);
-    auto [psqt, positional] = smallNet ? networks.small.evaluate(pos, accumulators, &caches.small)
-                                       : networks.big.evaluate(pos, accumulators, &caches.big);
-
-    Value nnue = (125 * psqt + 131 * positional) / 128;
+    auto [psqt, positional] =
+      networks.evaluate(smallNet ? NNUE::EmbeddedNNUEType::SMALL : NNUE::EmbeddedNNUEType::BIG, pos,
+                        accumulators, caches);
 
-    // Re-evaluate the position when higher eval accuracy is worth the time spent
-    if (smallNet && (std::abs(nnue) < 236))
+    // The small network decides whether the big one is needed, its work is
+    // lost then. The stack only computes the big accumulators from here.
+    if (smallNet && needs_big_net(psqt, positional))
     {
-        std::tie(psqt, positional) = networks.big.evaluate(pos, accumulators, &caches.big);
-        nnue                       = (125 * psqt + 131 * positional) / 128;
-        smallNet                   = false;
+        std::tie(psqt, positional) =
+          networks.evaluate(NNUE::EmbeddedNNUEType::BIG, pos, accumulators, caches);
+        accumulators.stats.fallbacks++;
     }
 
-    // Blend optimism and eval with nnue complexity
-    int nnueComplexity = std::abs(psqt - positional);
-    optimism += optimism * nnueComplexity / 468;
-    nnue -= nnue * nnueComplexity / 18000;
-
-    int material = 535 * pos.count<PAWN>() + pos.non_pawn_material();
-    int v        = (nnue * (77777 + material) + optimism * (7777 + material)) / 77777;
-
-    // Damp down the evaluation linearly when shuffling
-    v -= v * pos.rule50_count() / 212;
-
-    // Guarantee evaluation does not hit the tablebase range
-    v = std::clamp(v, VALUE_TB_LOSS_IN_MAX_PLY + 1, VALUE_TB_WIN_IN_MAX_PLY - 1);
-
-    return v;
+    return blend(psqt, positional, optimism, blend_material(pos), pos.rule50_count());
 }
 
-// Like evaluate(), but instead of returning a value, it returns
-// a string (suitable for outputting to stdout) that contains the detailed
-// descriptions and values of each evaluation term. Useful for debugging.
-// Trace scores are from white's point of view
-std::string Eval::trace(Position& pos, const Eval::NNUE::Networks& networks) {
-
-    if (pos.b.inCheck())
-        return "Final evaluation: none (in check)";
-
-    Eval::NNUE::AccumulatorStack accumulators;
-    auto                         caches = std::make_unique<Eval::NNUE::AccumulatorCaches>(networks);
-
-    std::stringstream ss;
-    ss << std::showpoint << std::noshowpos << std::fixed << std::setprecision(2);
-    ss << '\n' << NNUE::trace(pos, networks, *caches) << '\n';
-
-    ss << std::showpoint << std::showpos << std::fixed << std::setprecision(2) << std::setw(15);
-
-    auto [psqt, positional] = networks.big.evaluate(pos, accumulators, &caches->big);
-    Value v                 = psqt + positional;
-    v                       = pos.side_to_move() == WHITE ? v : -v;
-    ss << "NNUE evaluation        " << 0.01 * to_cp(v, pos) << " (white side)\n";
-
-    v = evaluate(networks, pos, accumulators, *caches, VALUE_ZERO);
-    v = pos.side_to_move() == WHITE ? v : -v;
-    ss << "Final evaluation       " << 0.01 * to_cp(v, pos) << " (white side)";
-    ss << " [with scaled NNUE, ...]";
-    ss << "\n";
+void Eval::evaluate_batch(const Eval::NNUE::Backend&       networks,
+                          const std::vector<chess::Board>& boards,
+                          Position&                        pos,
+                          Eval::NNUE::AccumulatorCaches&   caches,
+                          std::vector<Value>&              out) {
+
+    struct Entry {
+        bool                evaluated = false;  // Not in check
+        int                 material  = 0;
+        int                 rule50    = 0;
+        int                 kings     = 0;  // King squares, the key of the refresh caches
+        NNUE::NetworkOutput output;
+    };
+
+    std::vector<Entry>       entries(boards.size());
+    std::vector<std::size_t> small, big;
+
+    out.assign(boards.size(), VALUE_NONE);
+    for (std::size_t i = 0; i < boards.size(); ++i)
+    {
+        pos.set(boards[i]);
+        if (pos.in_check())
+            continue;
+
+        entries[i].evaluated = true;
+        entries[i].material  = blend_material(pos);
+        entries[i].rule50    = pos.rule50_count();
+        entries[i].kings     = pos.square<KING>(WHITE) * SQUARE_NB + pos.square<KING>(BLACK);
+        (use_smallnet(pos) ? small : big).push_back(i);
+    }
 
-    return ss.str();
+    // The accumulators are refreshed from the cache entry of the king square,
+    // positions with the same kings one after the other differ in few pieces
+    auto run = [&](NNUE::EmbeddedNNUEType type, std::vector<std::size_t>& indices) {
+        std::stable_sort(indices.begin(), indices.end(), [&](std::size_t a, std::size_t b) {
+            return entries[a].kings < entries[b].kings;
+        });
+
+        std::vector<NNUE::NetworkOutput> outputs(indices.size());
+        networks.evaluate_batch(
+          type, indices.size(),
+          [&](std::size_t k) -> Position& {
+              pos.set(boards[indices[k]]);
+              return pos;
+          },
+          caches, outputs.data());
+        for (std::size_t k = 0; k < indices.size(); ++k)
+            entries[indices[k]].output = outputs[k];
+    };
+
+    run(NNUE::EmbeddedNNUEType::SMALL, small);
+    for (std::size_t i : small)
+        if (auto [psqt, positional] = entries[i].output; needs_big_net(psqt, positional))
+            big.push_back(i);
+    run(NNUE::EmbeddedNNUEType::BIG, big);
+
+    for (std::size_t i = 0; i < boards.size(); ++i)
+        if (entries[i].evaluated)
+        {
+            auto [psqt, positional] = entries[i].output;
+            out[i] = blend(psqt, positional, 0, entries[i].material, entries[i].rule50);
+        }
 }
 
 }  // namespace Stockfish
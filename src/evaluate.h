@@ -19,10 +19,14 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
-#include <string>
+#include <vector>
 
 #include "types.h"
 
+namespace chess {
+class Board;
+}
+
 namespace Stockfish {
 
 class Position;
@@ -37,20 +41,27 @@ namespace Eval {
 #define EvalFileDefaultNameSmall "nn-37f18f62d772.nnue"
 
 namespace NNUE {
-struct Networks;
+class Backend;
 struct AccumulatorCaches;
 class AccumulatorStack;
 }
 
-std::string trace(Position& pos, const Eval::NNUE::Networks& networks);
-
 int   simple_eval(const Position& pos);
 bool  use_smallnet(const Position& pos);
-Value evaluate(const NNUE::Networks&          networks,
+Value evaluate(const NNUE::Backend&           networks,
                const Position&                pos,
                Eval::NNUE::AccumulatorStack&  accumulators,
                Eval::NNUE::AccumulatorCaches& caches,
                int                            optimism);
+
+// Static evaluations of many unrelated positions, for offline labeling: the
+// same values as evaluate() with no optimism, VALUE_NONE for positions in check.
+// pos is set up with each board in turn (a Position is expensive to create).
+void evaluate_batch(const NNUE::Backend&             networks,
+                    const std::vector<chess::Board>& boards,
+                    Position&                        pos,
+                    Eval::NNUE::AccumulatorCaches&   caches,
+                    std::vector<Value>&              out);
 }  // namespace Eval
 
 }  // namespace Stockfish
@@ -0,0 +1,163 @@
+#include "infosink.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace infosink {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+class Sink {
+   public:
+    Sink() :
+        writer(&Sink::write_loop, this) {}
+    ~Sink() { shutdown(); }
+
+    void post(std::string&& line) {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            currmove.clear();  // Superseded by the new line
+            buffer += line;
+            buffer += '\n';
+        }
+        cv.notify_all();
+    }
+
+    void post_currmove(std::string&& line) {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            currmove = std::move(line);
+        }
+        cv.notify_all();
+    }
+
+    void set_currmove_interval(int ms) {
+        std::lock_guard<std::mutex> lk(mutex);
+        interval = std::chrono::milliseconds(ms);
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&] { return buffer.empty() && !writing; });
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            exit = true;
+        }
+        cv.notify_all();
+        if (writer.joinable())
+            writer.join();
+    }
+
+   private:
+    void write_loop() {
+        std::unique_lock<std::mutex> lk(mutex);
+        while (true)
+        {
+            if (!currmove.empty() && Clock::now() >= nextCurrmove)
+            {
+                buffer += currmove;
+                buffer += '\n';
+                currmove.clear();
+                nextCurrmove = Clock::now() + interval;
+            }
+
+            if (buffer.empty())
+            {
+                if (exit)
+                    return;
+                if (currmove.empty())
+                    cv.wait(lk);
+                else
+                    cv.wait_until(lk, nextCurrmove);
+                continue;
+            }
+
+            // Write outside of the lock, the search keeps posting meanwhile
+            std::string out;
+            out.swap(buffer);
+            writing = true;
+            lk.unlock();
+            std::cout << out << std::flush;
+            lk.lock();
+            writing = false;
+            cv.notify_all();
+        }
+    }
+
+    std::mutex                mutex;
+    std::condition_variable   cv;
+    std::string               buffer;    // Complete lines waiting to be written
+    std::string               currmove;  // Latest pending 'info currmove' line
+    Clock::time_point         nextCurrmove{};
+    std::chrono::milliseconds interval{500};
+    bool                      writing = false, exit = false;
+    std::thread               writer;  // Last, it starts running write_loop() on construction
+};
+
+Sink sink;
+}  // namespace
+
+void post(std::string line) { sink.post(std::move(line)); }
+void post_currmove(std::string line) { sink.post_currmove(std::move(line)); }
+void set_currmove_interval(int ms) { sink.set_currmove_interval(ms); }
+void flush() { sink.flush(); }
+void shutdown() { sink.shutdown(); }
+
+void bench(std::ostream& out) {
+    constexpr int     Lines = 100000;
+    const std::string line =
+      "info depth 20 seldepth 28 multipv 1 score cp 31 nodes 12345678 nps 1234567 hashfull 123 "
+      "tbhits 0 time 10000 pv e2e4 e7e5 g1f3 b8c6 f1b5 a7a6 b5a4 g8f6 e1g1 f8e7";
+    const std::string currmove = "info currmove e2e4 currmovenum 1";
+
+    // The lines go to the null device through std::cout, as the sink writes
+    // them. The writer thread is idle while the buffer of std::cout changes.
+    flush();
+#if defined(_WIN32)
+    std::ofstream null("NUL");
+#else
+    std::ofstream null("/dev/null");
+#endif
+    std::streambuf* saved = std::cout.rdbuf(null.rdbuf());
+
+    auto ns_per_line = [&](Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Lines;
+    };
+
+    // Each line written and flushed by the search thread itself
+    auto start = Clock::now();
+    for (int i = 0; i < Lines; ++i)
+        std::cout << line << std::endl;
+    double direct = ns_per_line(start);
+
+    start = Clock::now();
+    for (int i = 0; i < Lines; ++i)
+        post(line);
+    double posted = ns_per_line(start);
+    flush();
+    double written = ns_per_line(start);
+
+    start = Clock::now();
+    for (int i = 0; i < Lines; ++i)
+        post_currmove(currmove);
+    double currmoves = ns_per_line(start);
+
+    // A line drops the pending currmove, which would be written later
+    post(line);
+    flush();
+    std::cout.rdbuf(saved);
+
+    out << "===========================\n";
+    out << "Lines           : " << Lines << "\n";
+    out << "cout + endl     : " << direct << " ns/line\n";
+    out << "post()          : " << posted << " ns/line, all written after " << written
+        << " ns/line\n";
+    out << "post_currmove() : " << currmoves << " ns/call" << std::endl;
+}
+}  // namespace infosink
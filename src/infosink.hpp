@@ -0,0 +1,32 @@
+#pragma once
+#include <ostream>
+#include <string>
+
+// Output of the search. Lines are queued by the search threads and written
+// to stdout by a dedicated writer thread, so that formatting is the only cost
+// on the search side and a slow reader of the pipe never stalls the search.
+namespace infosink {
+
+// Queue a complete line (without the trailing newline). Lines are written in
+// the order they were posted.
+void post(std::string line);
+
+// Queue an 'info currmove' line. At most one is written per currmove
+// interval, a newer line replaces a pending one and any other line drops it.
+void post_currmove(std::string line);
+
+// Minimum time between two 'info currmove' lines, 0 writes them all
+void set_currmove_interval(int ms);
+
+// Block until every queued line has been written and flushed
+void flush();
+
+// Write the queued lines and stop the writer thread. Called by quit once the
+// search is idle, nothing may be posted afterwards.
+void shutdown();
+
+// 'bench infosink': the cost of a line on the search thread, posted or
+// written directly, with the output going to the null device. Only while
+// nothing else is printing.
+void bench(std::ostream& out);
+}  // namespace infosink
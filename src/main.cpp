@@ -1,4 +1,5 @@
 #include <cstring>
+#include "infosink.hpp"
 #include "search.h"
 #include "uci.hpp"
 #include "ucioptions.hpp"
@@ -8,21 +9,50 @@ int main(int argc, char** argv) {
         search::tt.resize(std::get<int>(opt.value));
     });
     UCIOptions::setOption("Hash", "16");
+    UCIOptions::addSpin("MultiPV", 1, 1, 256);
+    UCIOptions::addCheck("Ponder", false);
+    UCIOptions::addSpin("Move Overhead", 10, 0, 5000, [](const UCIOptions::Option& opt) {
+        timeman::move_overhead = std::get<int>(opt.value);
+    });
+    UCIOptions::addSpin("CurrmoveInterval", 500, 0, 60000, [](const UCIOptions::Option& opt) {
+        infosink::set_currmove_interval(std::get<int>(opt.value));
+    });
     search::init<true>();
     UCIOptions::addString("NNUEEvalFileBig", EvalFileDefaultNameBig,
                           [](const UCIOptions::Option& opt) {
-                              search::nn->big.load(".", std::get<std::string>(opt.value));
+                              search::nn->load(Stockfish::Eval::NNUE::EmbeddedNNUEType::BIG, ".",
+                                               std::get<std::string>(opt.value));
+                              search::update_replicas();
                           });
     UCIOptions::addString("NNUEEvalFileSmall", EvalFileDefaultNameSmall,
                           [](const UCIOptions::Option& opt) {
-                              search::nn->small.load(".", std::get<std::string>(opt.value));
+                              search::nn->load(Stockfish::Eval::NNUE::EmbeddedNNUEType::SMALL, ".",
+                                               std::get<std::string>(opt.value));
+                              search::update_replicas();
                           });
+    UCIOptions::addCheck("NNUESharedMemory", false, [](const UCIOptions::Option& opt) {
+        search::nn->set_shared_memory(std::get<int>(opt.value) != 0);
+        search::update_replicas();
+    });
     search::init<false>();
+    UCIOptions::addCheck("NUMAReplication", true, [](const UCIOptions::Option& opt) {
+        search::set_numa_replication(std::get<int>(opt.value) != 0);
+    });
+    UCIOptions::addSpin("Threads", 1, 1, 1024, [](const UCIOptions::Option& opt) {
+        search::set_threads(std::get<int>(opt.value));
+    });
     if (argc == 2 && !strcmp(argv[1], "bench"))  // SF bench (Makefile)
     {
         handle_bench();
+        infosink::shutdown();
         return 0;
     }
-    uci_loop();
+    if (argc == 4 && !strcmp(argv[1], "convertnet"))  // convertnet <in.nnue> <out>
+    {
+        bool ok = convert_net(argv[2], argv[3]);
+        infosink::shutdown();
+        return ok ? 0 : 1;
+    }
+    uci_loop();  // Shuts the sink down on quit
     return 0;
 }
@@ -19,6 +19,7 @@
 #include "memory.h"
 
 #include <cstdlib>
+#include <ctime>
 
 #if __has_include("features.h")
     #include <features.h>
@@ -28,6 +29,14 @@
     #include <sys/mman.h>
 #endif
 
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) \
   || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32)) \
   || defined(__e2k__)
@@ -263,4 +272,155 @@ void aligned_large_pages_free(void* mem) {
 void aligned_large_pages_free(void* mem) { std_aligned_free(mem); }
 
 #endif
-}  // namespace NNUEParser
\ No newline at end of file
+
+#if !defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& path) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    map(fd, false);
+    close(fd);  // The mapping keeps the file
+}
+
+MappedFile::~MappedFile() {
+    if (mem)
+        munmap(mem, len);
+    if (lockFd >= 0)
+        close(lockFd);  // Unpublished, the others see it abandoned
+}
+
+void MappedFile::map(int fd, bool write) {
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        return;
+
+    void* p = mmap(nullptr, size_t(st.st_size), write ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return;
+
+    mem      = static_cast<char*>(p);
+    len      = size_t(st.st_size);
+    writable = write;
+    #if defined(MADV_HUGEPAGE)
+    madvise(p, len, MADV_HUGEPAGE);
+    #endif
+    if (!write)
+        madvise(p, len, MADV_WILLNEED);  // Read ahead in the background
+}
+
+#else
+
+// Not built yet: no Windows compiler to check CreateFileMapping() and
+// MapViewOfFile() with. data() stays null, raw nets do not load on Windows.
+MappedFile::MappedFile(const std::string&) {}
+MappedFile::~MappedFile() {}
+void MappedFile::map(int, bool) {}
+
+#endif
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+
+std::shared_ptr<const MappedFile> MappedFile::open_shared_memory(const std::string& name) {
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+
+    // Anyone can take the name first, trust only what this user wrote
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_uid != geteuid())
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->map(fd, false);
+    close(fd);
+    return file;
+}
+
+std::shared_ptr<MappedFile> MappedFile::create_shared_memory(const std::string& name) {
+
+    // Writable until it is published, by this user only
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return nullptr;
+
+    // Nobody else has the object yet, the lock is free. It is taken before the
+    // object grows, so a non-empty object that is unlocked and unpublished is
+    // abandoned.
+    if (flock(fd, LOCK_EX) != 0)
+    {
+        shm_unlink(name.c_str());
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->lockFd = fd;
+    return file;
+}
+
+bool MappedFile::remove_abandoned_shared_memory(const std::string& name) {
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    // The creator unlocks the object when it publishes it or dies. An empty
+    // object may not be locked yet, unless it is older than a second. Holding
+    // the lock, this process is the only one that can remove the object: check
+    // that it was not removed already, the name may be a new object by now.
+    struct stat st;
+    bool        abandoned = flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0
+                   && st.st_uid == geteuid() && (st.st_mode & S_IWUSR)
+                   && (st.st_size > 0 || std::time(nullptr) - st.st_ctime > 1);
+    if (abandoned && st.st_nlink > 0)
+        shm_unlink(name.c_str());
+    close(fd);
+    return abandoned;
+}
+
+void MappedFile::remove_shared_memory(const std::string& name) { shm_unlink(name.c_str()); }
+
+bool MappedFile::resize(size_t size) {
+
+    if (lockFd < 0 || mem || ftruncate(lockFd, off_t(size)) != 0)
+        return false;
+
+    map(lockFd, true);
+    return mem != nullptr;
+}
+
+void MappedFile::publish() {
+
+    if (lockFd < 0)
+        return;
+
+    fchmod(lockFd, 0400);
+    close(lockFd);
+    lockFd = -1;
+}
+
+#else
+
+std::shared_ptr<const MappedFile> MappedFile::open_shared_memory(const std::string&) {
+    return nullptr;
+}
+std::shared_ptr<MappedFile> MappedFile::create_shared_memory(const std::string&) {
+    return nullptr;
+}
+bool MappedFile::remove_abandoned_shared_memory(const std::string&) { return false; }
+void MappedFile::remove_shared_memory(const std::string&) {}
+bool MappedFile::resize(size_t) { return false; }
+void MappedFile::publish() {}
+
+#endif
+
+}  // namespace NNUEParser
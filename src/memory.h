@@ -25,6 +25,7 @@
 #include <cstdint>
 #include <memory>
 #include <new>
+#include <string>
 #include <type_traits>
 #include <utility>
 #define ASSERT_ALIGNED(ptr, alignment) assert(reinterpret_cast<uintptr_t>(ptr) % alignment == 0)
@@ -211,6 +212,64 @@ T* align_ptr_up(T* ptr) {
       reinterpret_cast<char*>((ptrint + (Alignment - 1)) / Alignment * Alignment));
 }
 
+// A file mapped read-only into memory, with a huge page hint. The pages come
+// from the page cache: every process that maps the same file shares them and
+// nothing is read until it is used. data() is null when the file cannot be
+// opened or mapped, and on Windows, where mapping is not implemented yet.
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // POSIX shared memory objects (shm_open()), named '/name'. They stay until
+    // they are removed (rm /dev/shm/name on Linux) or the system restarts, and
+    // only the user that created them can open them. Null on Windows and
+    // Android.
+
+    // Maps the object read-only, null if it does not exist or belongs to
+    // another user. data() is null while it is empty.
+    static std::shared_ptr<const MappedFile> open_shared_memory(const std::string& name);
+
+    // Creates the object, empty, unless it exists: of the processes that try,
+    // one fills it and the others wait for it. The object stays locked until
+    // it is published or the returned MappedFile is destroyed, so that the
+    // others can tell a dead creator from a slow one.
+    static std::shared_ptr<MappedFile> create_shared_memory(const std::string& name);
+
+    // Removes the object if it was never published and its creator is gone,
+    // then another process can create it again. True if it was removed.
+    static bool remove_abandoned_shared_memory(const std::string& name);
+
+    // Removes the name, the mappings stay valid
+    static void remove_shared_memory(const std::string& name);
+
+    // Sets the size of an object this process created and maps it writable
+    bool resize(size_t size);
+
+    // Makes an object this process filled read-only and unlocks it
+    void publish();
+
+    const char* data() const { return mem; }
+    size_t      size() const { return len; }
+
+    // Null unless mapped by resize()
+    char* writable_data() { return writable ? mem : nullptr; }
+
+   private:
+    MappedFile() = default;
+    void map(int fd, bool write);
+
+    char*  mem      = nullptr;
+    size_t len      = 0;
+    bool   writable = false;
+#if !defined(_WIN32)
+    int lockFd = -1;  // Of an object this process creates until it is published
+#endif
+};
+
 }  // namespace NNUEParser
 namespace Stockfish {
 using namespace NNUEParser;
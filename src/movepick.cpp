@@ -83,7 +83,7 @@ int SEE(chess::Board& board, chess::Move move) {
 
     chess::Square next_attacker_sq = from_sq;
 
-    while (++d < max_gain_size)
+    while (++d < max_gain_size - 1)
     {
         side = ~side;
 
@@ -100,6 +100,8 @@ int SEE(chess::Board& board, chess::Move move) {
         attackers |= bishop_attacks
                    & (board.pieces(chess::PieceType::BISHOP, side)
                       | board.pieces(chess::PieceType::QUEEN, side));
+        // Sliders that already took part in the exchange are no longer on the board
+        attackers &= occ;
 
         if (attackers.empty())
             break;
@@ -126,7 +128,7 @@ int SEE(chess::Board& board, chess::Move move) {
 }
 
 // 2. Killer moves
-chess::Move killerMoves[Stockfish::MAX_PLY][2] = {};
+thread_local chess::Move killerMoves[Stockfish::MAX_PLY][2] = {};
 
 void updateKillerMoves(chess::Move m, int ply) {
     if (killerMoves[ply][0] != m)
@@ -137,7 +139,7 @@ void updateKillerMoves(chess::Move m, int ply) {
 }
 
 // 3. History heuristic
-int historyHeuristic[64][64] = {};  // from-square to to-square
+thread_local int historyHeuristic[64][64] = {};  // from-square to to-square
 
 void updateHistoryHeuristic(chess::Move m, int depth) {
     historyHeuristic[m.from().index()][m.to().index()] += depth * depth;
@@ -13,5 +13,6 @@ void orderMoves(chess::Board&, chess::Movelist&, chess::Move, int);
 // Orders moves for quiescence search (captures/promotions)
 void qOrderMoves(chess::Board&, chess::Movelist&);
 // Killer moves table: [ply][slot] for move ordering heuristic
-extern chess::Move killerMoves[Stockfish::MAX_PLY][2];
+// (per search thread, like the history table)
+extern thread_local chess::Move killerMoves[Stockfish::MAX_PLY][2];
 }  // namespace movepick
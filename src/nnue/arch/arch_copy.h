@@ -0,0 +1,91 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compiles the NNUE code once more for the instruction set described by
+// NNUE_ARCH (the inline namespace and the name of the factory),
+// NNUE_ARCH_TARGET (the target attribute) and the USE_* macros the including
+// file defines after this header (see NNUE_ARCH_BEGIN).
+//
+// The target attribute must only apply to code of this copy: everything else
+// (the standard library, the instruction set independent headers) is included
+// before it, so that their inline functions and templates are compiled for
+// the baseline, which every copy may call and inline. The code of the copy
+// lives in its own inline namespace, so no function of it can be merged with
+// one of another copy by the linker.
+
+#ifndef NNUE_ARCH_COPY_H_INCLUDED
+#define NNUE_ARCH_COPY_H_INCLUDED
+
+#if !defined(__GNUC__)
+    #error "Runtime dispatch of the NNUE code needs gcc or clang"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "../../bitboard.h"
+#include "../../evaluate.h"
+#include "../../memory.h"
+#include "../../misc.h"
+#include "../../perfcount.hpp"
+#include "../../position.h"
+#include "../../types.h"
+#include "../features/half_ka_v2_hm.h"
+#include "../nnue_accumulator.h"
+#include "../nnue_backend.h"
+#include "../nnue_common.h"
+
+#define NNUE_ARCH_COPY
+
+#define NNUE_PRAGMA_(x) _Pragma(#x)
+#define NNUE_PRAGMA(x) NNUE_PRAGMA_(x)
+
+#if defined(__clang__)
+    #define NNUE_ARCH_BEGIN \
+        NNUE_PRAGMA(clang attribute push(__attribute__((target(NNUE_ARCH_TARGET))), \
+                                         apply_to = function))
+    #define NNUE_ARCH_END _Pragma("clang attribute pop")
+#else
+    #define NNUE_ARCH_BEGIN \
+        _Pragma("GCC push_options") NNUE_PRAGMA(GCC target(NNUE_ARCH_TARGET))
+    #define NNUE_ARCH_END _Pragma("GCC pop_options")
+#endif
+
+#endif  // #ifndef NNUE_ARCH_COPY_H_INCLUDED
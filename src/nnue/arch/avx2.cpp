@@ -0,0 +1,19 @@
+// AVX2 copy of the NNUE code for runtime dispatch, see arch_copy.h
+
+#define NNUE_ARCH avx2
+#define NNUE_ARCH_TARGET "avx2,bmi,popcnt"
+#include "arch_copy.h"
+
+NNUE_ARCH_BEGIN
+
+#define USE_SSE2 1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX2 1
+
+#include "../network.cpp"
+#include "../nnue_accumulator.cpp"
+#include "../nnue_backend.cpp"
+#include "../nnue_bench.cpp"
+
+NNUE_ARCH_END
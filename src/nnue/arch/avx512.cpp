@@ -0,0 +1,20 @@
+// AVX-512 copy of the NNUE code for runtime dispatch, see arch_copy.h
+
+#define NNUE_ARCH avx512
+#define NNUE_ARCH_TARGET "avx2,bmi,popcnt,avx512f,avx512bw"
+#include "arch_copy.h"
+
+NNUE_ARCH_BEGIN
+
+#define USE_SSE2 1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX2 1
+#define USE_AVX512 1
+
+#include "../network.cpp"
+#include "../nnue_accumulator.cpp"
+#include "../nnue_backend.cpp"
+#include "../nnue_bench.cpp"
+
+NNUE_ARCH_END
@@ -0,0 +1,21 @@
+// AVX-VNNI copy of the NNUE code for runtime dispatch, see arch_copy.h
+
+#define NNUE_ARCH avxvnni
+#define NNUE_ARCH_TARGET "avx2,bmi,popcnt,avxvnni"
+#include "arch_copy.h"
+
+NNUE_ARCH_BEGIN
+
+#define USE_SSE2 1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX2 1
+#define USE_VNNI 1
+#define USE_AVXVNNI 1
+
+#include "../network.cpp"
+#include "../nnue_accumulator.cpp"
+#include "../nnue_backend.cpp"
+#include "../nnue_bench.cpp"
+
+NNUE_ARCH_END
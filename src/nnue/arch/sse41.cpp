@@ -0,0 +1,18 @@
+// SSE4.1 copy of the NNUE code for runtime dispatch, see arch_copy.h
+
+#define NNUE_ARCH sse41
+#define NNUE_ARCH_TARGET "sse2,ssse3,sse4.1,popcnt"
+#include "arch_copy.h"
+
+NNUE_ARCH_BEGIN
+
+#define USE_SSE2 1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+
+#include "../network.cpp"
+#include "../nnue_accumulator.cpp"
+#include "../nnue_backend.cpp"
+#include "../nnue_bench.cpp"
+
+NNUE_ARCH_END
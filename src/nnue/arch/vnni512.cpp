@@ -0,0 +1,21 @@
+// AVX-512 VNNI copy of the NNUE code for runtime dispatch, see arch_copy.h
+
+#define NNUE_ARCH vnni512
+#define NNUE_ARCH_TARGET "avx2,bmi,popcnt,avx512f,avx512bw,avx512vnni,avx512dq,avx512vl"
+#include "arch_copy.h"
+
+NNUE_ARCH_BEGIN
+
+#define USE_SSE2 1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX2 1
+#define USE_AVX512 1
+#define USE_VNNI 1
+
+#include "../network.cpp"
+#include "../nnue_accumulator.cpp"
+#include "../nnue_backend.cpp"
+#include "../nnue_bench.cpp"
+
+NNUE_ARCH_END
@@ -37,7 +37,9 @@
     - accumulation happens directly to int32s
 */
 
-namespace Stockfish::Eval::NNUE::Layers {
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+namespace Layers {
 
 #if defined(USE_SSSE3) || defined(USE_NEON_DOTPROD)
     #define ENABLE_SEQ_OPT
@@ -297,6 +299,8 @@ class AffineTransform {
     alignas(CacheLineSize) WeightType weights[OutputDimensions * PaddedInputDimensions];
 };
 
-}  // namespace Stockfish::Eval::NNUE::Layers
+}  // namespace Layers
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
 
 #endif  // #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
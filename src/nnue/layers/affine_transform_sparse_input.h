@@ -33,7 +33,9 @@
   This file contains the definition for a fully connected layer (aka affine transform) with block sparse input.
 */
 
-namespace Stockfish::Eval::NNUE::Layers {
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+namespace Layers {
 
 #if (USE_SSSE3 | (USE_NEON >= 8))
 static constexpr int lsb_index64[64] = {
@@ -138,6 +140,9 @@ class AffineTransformSparseInput {
     static constexpr IndexType ChunkSize = 1;
 #endif
 
+    // Accumulator registers propagate() keeps in flight, at least
+    static constexpr IndexType AccumulatorRegs = 4;
+
     using OutputBuffer = OutputType[PaddedOutputDimensions];
 
     // Hash value embedded in the evaluation file
@@ -189,26 +194,36 @@ class AffineTransformSparseInput {
         using outvec_t = __m512i;
         #define vec_set_32 _mm512_set1_epi32
         #define vec_add_dpbusd_32 SIMD::m512_add_dpbusd_epi32
+        #define vec_add_32 _mm512_add_epi32
+        #define vec_zero_32 _mm512_setzero_si512
     #elif defined(USE_AVX2)
         using invec_t  = __m256i;
         using outvec_t = __m256i;
         #define vec_set_32 _mm256_set1_epi32
         #define vec_add_dpbusd_32 SIMD::m256_add_dpbusd_epi32
+        #define vec_add_32 _mm256_add_epi32
+        #define vec_zero_32 _mm256_setzero_si256
     #elif defined(USE_SSSE3)
         using invec_t  = __m128i;
         using outvec_t = __m128i;
         #define vec_set_32 _mm_set1_epi32
         #define vec_add_dpbusd_32 SIMD::m128_add_dpbusd_epi32
+        #define vec_add_32 _mm_add_epi32
+        #define vec_zero_32 _mm_setzero_si128
     #elif defined(USE_NEON_DOTPROD)
         using invec_t  = int8x16_t;
         using outvec_t = int32x4_t;
         #define vec_set_32(a) vreinterpretq_s8_u32(vdupq_n_u32(a))
         #define vec_add_dpbusd_32 SIMD::dotprod_m128_add_dpbusd_epi32
+        #define vec_add_32 vaddq_s32
+        #define vec_zero_32() vdupq_n_s32(0)
     #elif defined(USE_NEON)
         using invec_t  = int8x16_t;
         using outvec_t = int32x4_t;
         #define vec_set_32(a) vreinterpretq_s8_u32(vdupq_n_u32(a))
         #define vec_add_dpbusd_32 SIMD::neon_m128_add_dpbusd_epi32
+        #define vec_add_32 vaddq_s32
+        #define vec_zero_32() vdupq_n_s32(0)
     #endif
         static constexpr IndexType OutputSimdWidth = sizeof(outvec_t) / sizeof(OutputType);
 
@@ -222,26 +237,45 @@ class AffineTransformSparseInput {
         // Find indices of nonzero 32-bit blocks
         find_nnz<NumChunks>(input32, nnz, count);
 
+        // With few outputs, each dot product would wait for the one of the
+        // previous chunk: the chunks go in turn to NumAccs sets of registers,
+        // added up at the end. The sums are of integers, in any order the same.
+        constexpr IndexType NumAccs = NumRegs >= AccumulatorRegs ? 1 : AccumulatorRegs / NumRegs;
+
         const outvec_t* biasvec = reinterpret_cast<const outvec_t*>(biases);
-        outvec_t        acc[NumRegs];
+        outvec_t        acc[NumAccs][NumRegs];
         for (IndexType k = 0; k < NumRegs; ++k)
-            acc[k] = biasvec[k];
+            acc[0][k] = biasvec[k];
+        for (IndexType a = 1; a < NumAccs; ++a)
+            for (IndexType k = 0; k < NumRegs; ++k)
+                acc[a][k] = vec_zero_32();
 
-        for (IndexType j = 0; j < count; ++j)
-        {
-            const auto    i  = nnz[j];
+        auto add_chunk = [&](outvec_t* accs, IndexType i) {
             const invec_t in = vec_set_32(input32[i]);
             const auto    col =
               reinterpret_cast<const invec_t*>(&weights[i * OutputDimensions * ChunkSize]);
             for (IndexType k = 0; k < NumRegs; ++k)
-                vec_add_dpbusd_32(acc[k], in, col[k]);
-        }
+                vec_add_dpbusd_32(accs[k], in, col[k]);
+        };
+
+        IndexType j = 0;
+        for (; j + NumAccs <= count; j += NumAccs)
+            for (IndexType a = 0; a < NumAccs; ++a)
+                add_chunk(acc[a], nnz[j + a]);
+        for (; j < count; ++j)
+            add_chunk(acc[0], nnz[j]);
+
+        for (IndexType a = 1; a < NumAccs; ++a)
+            for (IndexType k = 0; k < NumRegs; ++k)
+                acc[0][k] = vec_add_32(acc[0][k], acc[a][k]);
 
         outvec_t* outptr = reinterpret_cast<outvec_t*>(output);
         for (IndexType k = 0; k < NumRegs; ++k)
-            outptr[k] = acc[k];
+            outptr[k] = acc[0][k];
     #undef vec_set_32
     #undef vec_add_dpbusd_32
+    #undef vec_add_32
+    #undef vec_zero_32
 #else
         // Use dense implementation for the other architectures.
         affine_transform_non_ssse3<InputDimensions, PaddedInputDimensions, OutputDimensions>(
@@ -257,6 +291,8 @@ class AffineTransformSparseInput {
     alignas(CacheLineSize) WeightType weights[OutputDimensions * PaddedInputDimensions];
 };
 
-}  // namespace Stockfish::Eval::NNUE::Layers
+}  // namespace Layers
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
 
 #endif  // #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_SPARSE_INPUT_H_INCLUDED
@@ -26,8 +26,11 @@
 #include <iosfwd>
 
 #include "../nnue_common.h"
+#include "../simd.h"
 
-namespace Stockfish::Eval::NNUE::Layers {
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+namespace Layers {
 
 // Clipped ReLU
 template<IndexType InDims>
@@ -159,6 +162,8 @@ class ClippedReLU {
     }
 };
 
-}  // namespace Stockfish::Eval::NNUE::Layers
+}  // namespace Layers
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
 
 #endif  // NNUE_LAYERS_CLIPPED_RELU_H_INCLUDED
@@ -26,8 +26,11 @@
 #include <iosfwd>
 
 #include "../nnue_common.h"
+#include "../simd.h"
 
-namespace Stockfish::Eval::NNUE::Layers {
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+namespace Layers {
 
 // Clipped ReLU
 template<IndexType InDims>
@@ -98,6 +101,8 @@ class SqrClippedReLU {
     }
 };
 
-}  // namespace Stockfish::Eval::NNUE::Layers
+}  // namespace Layers
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
 
 #endif  // NNUE_LAYERS_SQR_CLIPPED_RELU_H_INCLUDED
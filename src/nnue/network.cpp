@@ -18,11 +18,19 @@
 
 #include "network.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <sstream>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -46,8 +54,22 @@
 //     const unsigned int         gEmbeddedNNUESize;    // the size of the embedded file
 // Note that this does not work in Microsoft Visual Studio.
 #if !defined(_MSC_VER) && !defined(NNUE_EMBEDDING_OFF)
+    #if defined(NNUE_ARCH_COPY)
+// The other instruction sets share the data embedded by the default build.
+// These are the declarations of INCBIN_EXTERN(), whose variadic form warns
+// under -pedantic.
+extern "C" {
+extern const unsigned char        gEmbeddedNNUEBigData[];
+extern const unsigned char* const gEmbeddedNNUEBigEnd;
+extern const unsigned int         gEmbeddedNNUEBigSize;
+extern const unsigned char        gEmbeddedNNUESmallData[];
+extern const unsigned char* const gEmbeddedNNUESmallEnd;
+extern const unsigned int         gEmbeddedNNUESmallSize;
+}
+    #else
 INCBIN(EmbeddedNNUEBig, EvalFileDefaultNameBig);
 INCBIN(EmbeddedNNUESmall, EvalFileDefaultNameSmall);
+    #endif
 #else
 const unsigned char        gEmbeddedNNUEBigData[1]   = {0x0};
 const unsigned char* const gEmbeddedNNUEBigEnd       = &gEmbeddedNNUEBigData[1];
@@ -80,12 +102,67 @@ EmbeddedNNUE get_embedded(EmbeddedNNUEType type) {
         return EmbeddedNNUE(gEmbeddedNNUESmallData, gEmbeddedNNUESmallEnd, gEmbeddedNNUESmallSize);
 }
 
+// C++ way to prepare a buffer for a memory stream
+class MemoryBuffer: public std::basic_streambuf<char> {
+   public:
+    MemoryBuffer(char* p, size_t n) {
+        setg(p, p, p + n);
+        setp(p, p + n);
+    }
+};
+
+// A raw net (written by save_raw(), 'convertnet') starts with this header.
+// The feature transformer follows at RawAlignment, exactly as it is in
+// memory: permuted, scaled and uncompressed, in the byte order of the machine
+// that converted it, so that it can be used where it is mapped. After it come
+// the header and the layer stacks of a .nnue file.
+constexpr char        RawMagic[8]  = {'N', 'N', 'U', 'E', 'R', 'A', 'W', '\0'};
+constexpr std::size_t RawAlignment = 2 * 1024 * 1024;  // For huge pages of the mapping
+
+struct RawHeader {
+    char          magic[8];
+    std::uint32_t version;          // Version of the .nnue format
+    std::uint32_t hash;             // Network::hash
+    std::uint64_t transformerSize;  // sizeof(Transformer)
+    std::uint64_t order[8];         // Transformer::PackusEpi16Order of the converting build
+    std::uint64_t checksum;         // raw_checksum() of the rest, checked before use
+};
+
+// How long load_shared() waits for another process to fill the shared memory
+// object before it reads the net itself
+constexpr auto SharedMemoryWait = std::chrono::seconds(10);
+
+// Tells apart the nets of the same architecture, not meant to resist tampering
+std::uint64_t checksum(const char* data, std::size_t size) {
+    std::uint64_t h = size;
+    std::size_t   i = 0;
+
+    for (; i + 8 <= size; i += 8)
+    {
+        std::uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 32;
+    }
+    for (; i < size; ++i)
+        h = (h ^ std::uint8_t(data[i])) * 0x100000001B3ull;
+    return h;
 }
 
+bool is_published(const std::shared_ptr<const Stockfish::MappedFile>& object) {
+    if (!object->data() || object->size() < sizeof(RawHeader)
+        || !std::equal(std::begin(RawMagic), std::end(RawMagic), object->data()))
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
 
-namespace Stockfish::Eval::NNUE {
+}
 
 
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+
 namespace Detail {
 
 // Read evaluation function parameters
@@ -109,13 +186,68 @@ bool write_parameters(std::ostream& stream, T& reference) {
 
 }  // namespace Detail
 
+namespace {
+
+std::uint64_t raw_checksum(const char* transformer,
+                           std::size_t transformerSize,
+                           const char* layers,
+                           std::size_t layersSize) {
+    return checksum(transformer, transformerSize) * 0x100000001B3ull
+         ^ checksum(layers, layersSize);
+}
+
+// Whether a published object holds what its creator wrote, checked before it
+// is used: a creator that wrote past the end or a net that changed since
+bool is_intact(const std::shared_ptr<const Stockfish::MappedFile>& object) {
+    RawHeader header;
+    std::memcpy(&header, object->data(), sizeof(header));
+
+    if (object->size() < RawAlignment
+        || header.transformerSize > object->size() - RawAlignment)
+        return false;
+
+    const char*       transformer = object->data() + RawAlignment;
+    const std::size_t layersSize  = object->size() - RawAlignment - header.transformerSize;
+    return header.checksum
+        == raw_checksum(transformer, header.transformerSize,
+                        transformer + header.transformerSize, layersSize);
+}
+
+template<typename Transformer>
+RawHeader make_raw_header(std::uint32_t      hash,
+                          const Transformer& transformer,
+                          const std::string& layers) {
+    RawHeader header{};
+    std::copy(std::begin(RawMagic), std::end(RawMagic), header.magic);
+    header.version         = Version;
+    header.hash            = hash;
+    header.transformerSize = sizeof(Transformer);
+    std::copy(Transformer::PackusEpi16Order.begin(), Transformer::PackusEpi16Order.end(),
+              header.order);
+    header.checksum = raw_checksum(reinterpret_cast<const char*>(&transformer),
+                                   sizeof(Transformer), layers.data(), layers.size());
+    return header;
+}
+
+}  // namespace
+
 template<typename Arch, typename Transformer>
 Network<Arch, Transformer>::Network(const Network<Arch, Transformer>& other) :
     evalFile(other.evalFile),
-    embeddedType(other.embeddedType) {
+    embeddedType(other.embeddedType),
+    sharedMemory(other.sharedMemory) {
 
-    if (other.featureTransformer)
-        featureTransformer = make_unique_large_page<Transformer>(*other.featureTransformer);
+    // A mapped feature transformer is read-only, it can be shared
+    if (other.mapping)
+    {
+        mapping            = other.mapping;
+        featureTransformer = other.featureTransformer;
+    }
+    else if (other.featureTransformer)
+    {
+        ownedTransformer   = make_unique_large_page<Transformer>(*other.featureTransformer);
+        featureTransformer = ownedTransformer.get();
+    }
 
     network = make_unique_aligned<Arch[]>(LayerStacks);
 
@@ -131,9 +263,16 @@ Network<Arch, Transformer>&
 Network<Arch, Transformer>::operator=(const Network<Arch, Transformer>& other) {
     evalFile     = other.evalFile;
     embeddedType = other.embeddedType;
+    sharedMemory = other.sharedMemory;
 
-    if (other.featureTransformer)
-        featureTransformer = make_unique_large_page<Transformer>(*other.featureTransformer);
+    ownedTransformer.reset();
+    mapping            = other.mapping;
+    featureTransformer = other.featureTransformer;
+    if (other.featureTransformer && !other.mapping)
+    {
+        ownedTransformer   = make_unique_large_page<Transformer>(*other.featureTransformer);
+        featureTransformer = ownedTransformer.get();
+    }
 
     network = make_unique_aligned<Arch[]>(LayerStacks);
 
@@ -146,6 +285,17 @@ Network<Arch, Transformer>::operator=(const Network<Arch, Transformer>& other) {
     return *this;
 }
 
+template<typename Arch, typename Transformer>
+void Network<Arch, Transformer>::copy_mapping() {
+    if (!mapping)
+        return;
+
+    ownedTransformer   = make_unique_large_page<Transformer>(*featureTransformer);
+    featureTransformer = ownedTransformer.get();
+    mapping.reset();
+}
+
+
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::load(const std::string& rootDirectory, std::string evalfilePath) {
 #if defined(DEFAULT_NNUE_DIRECTORY)
@@ -207,6 +357,29 @@ bool Network<Arch, Transformer>::save(const std::optional<std::string>& filename
 }
 
 
+template<typename Arch, typename Transformer>
+bool Network<Arch, Transformer>::save_raw(const std::string& filename) const {
+    if (!featureTransformer || evalFile.current.empty())
+        return false;
+
+    std::ostringstream tail;
+    if (!write_header(tail, Network::hash, evalFile.netDescription))
+        return false;
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        if (!Detail::write_parameters(tail, network[i]))
+            return false;
+    const std::string layers = tail.str();
+    const RawHeader   header = make_raw_header(Network::hash, *featureTransformer, layers);
+
+    std::ofstream stream(filename, std::ios_base::binary);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.seekp(RawAlignment);  // The gap stays a hole in the file
+    stream.write(reinterpret_cast<const char*>(featureTransformer), sizeof(Transformer));
+    stream.write(layers.data(), layers.size());
+    return bool(stream);
+}
+
+
 template<typename Arch, typename Transformer>
 NetworkOutput
 Network<Arch, Transformer>::evaluate(const Position&                         pos,
@@ -228,6 +401,66 @@ Network<Arch, Transformer>::evaluate(const Position&                         pos
 }
 
 
+template<typename Arch, typename Transformer>
+void Network<Arch, Transformer>::evaluate_batch(
+  std::size_t                                  n,
+  const std::function<Position&(std::size_t)>& position,
+  AccumulatorCaches::Cache<FTDimensions>*      cache,
+  NetworkOutput*                               output) const {
+
+    constexpr std::size_t BatchSize = Arch::MaxBatch;
+
+    struct alignas(CacheLineSize) Batch {
+        TransformedFeatureType transformedFeatures[BatchSize][Transformer::BufferSize];
+        std::int32_t           psqt[BatchSize];
+        int                    bucket[BatchSize];
+    };
+
+    auto batch = make_unique_aligned<Batch>();
+
+    for (std::size_t first = 0; first < n; first += BatchSize)
+    {
+        const std::size_t size = std::min(BatchSize, n - first);
+
+        // Accumulators from the caches, one position at a time: the positions
+        // are unrelated, there is nothing to update incrementally
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            Position& pos    = position(first + i);
+            batch->bucket[i] = (pos.count<ALL_PIECES>() - 1) / 4;
+            batch->psqt[i]   = featureTransformer->transform(
+              pos, pos.stack, cache, batch->transformedFeatures[i], batch->bucket[i]);
+        }
+
+        // Then the layer stack of each bucket over all of its positions
+        for (int bucket = 0; bucket < int(LayerStacks); ++bucket)
+        {
+            const TransformedFeatureType* inputs[BatchSize];
+            std::size_t                   index[BatchSize];
+            std::int32_t                  positional[BatchSize];
+            std::size_t                   count = 0;
+
+            for (std::size_t i = 0; i < size; ++i)
+                if (batch->bucket[i] == bucket)
+                {
+                    inputs[count]  = batch->transformedFeatures[i];
+                    index[count++] = i;
+                }
+
+            if (!count)
+                continue;
+
+            network[bucket].propagate_batch(inputs, count, positional);
+
+            for (std::size_t k = 0; k < count; ++k)
+                output[first + index[k]] = {
+                  static_cast<Value>(batch->psqt[index[k]] / OutputScale),
+                  static_cast<Value>(positional[k] / OutputScale)};
+        }
+    }
+}
+
+
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::verify(std::string                                  evalfilePath,
                                         const std::function<void(std::string_view)>& f) const {
@@ -261,7 +494,8 @@ void Network<Arch, Transformer>::verify(std::string
     {
         size_t size = sizeof(*featureTransformer) + sizeof(Arch) * LayerStacks;
         f("NNUE evaluation using " + evalfilePath + " (" + std::to_string(size / (1024 * 1024))
-          + "MiB, (" + std::to_string(featureTransformer->InputDimensions) + ", "
+          + "MiB" + (mapping ? " mapped" : "") + ", ("
+          + std::to_string(featureTransformer->InputDimensions) + ", "
           + std::to_string(network[0].TransformedFeatureDimensions) + ", "
           + std::to_string(network[0].FC_0_OUTPUTS) + ", " + std::to_string(network[0].FC_1_OUTPUTS)
           + ", 1))");
@@ -301,8 +535,39 @@ Network<Arch, Transformer>::trace_evaluate(const Position&
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::load_user_net(const std::string& dir,
                                                const std::string& evalfilePath) {
-    std::ifstream stream(dir + evalfilePath, std::ios::binary);
-    auto          description = load(stream);
+    const std::string          path = dir + evalfilePath;
+    std::optional<std::string> description;
+
+    // The header tells a raw net, which is mapped, from a .nnue net
+    char          header[sizeof(RawHeader)];
+    std::ifstream probe(path, std::ios::binary);
+    probe.read(header, sizeof(header));
+    const bool raw = probe.gcount() == std::streamsize(sizeof(header))
+                  && std::equal(std::begin(RawMagic), std::end(RawMagic), header);
+    probe.close();
+
+    if (raw)
+    {
+        // Checked like a shared object: a file cut short or changed since it
+        // was converted is not used. This reads the whole file once.
+        auto file = std::make_shared<const MappedFile>(path);
+        if (file->data() && file->size() >= sizeof(RawHeader) && is_intact(file))
+            description = load_raw(file);
+    }
+    else
+    {
+        std::shared_ptr<const MappedFile> file;
+        if (sharedMemory)
+            file = std::make_shared<const MappedFile>(path);
+
+        if (file && file->data())
+            description = load_shared(file->data(), file->size());
+        else
+        {
+            std::ifstream stream(path, std::ios::binary);
+            description = load(stream);
+        }
+    }
 
     if (description.has_value())
     {
@@ -314,22 +579,18 @@ void Network<Arch, Transformer>::load_user_net(const std::string& dir,
 
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::load_internal() {
-    // C++ way to prepare a buffer for a memory stream
-    class MemoryBuffer: public std::basic_streambuf<char> {
-       public:
-        MemoryBuffer(char* p, size_t n) {
-            setg(p, p, p + n);
-            setp(p, p + n);
-        }
-    };
+    const auto  embedded = get_embedded(embeddedType);
+    const char* data     = reinterpret_cast<const char*>(embedded.data);
 
-    const auto embedded = get_embedded(embeddedType);
-
-    MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(embedded.data)),
-                        size_t(embedded.size));
-
-    std::istream stream(&buffer);
-    auto         description = load(stream);
+    std::optional<std::string> description;
+    if (sharedMemory)
+        description = load_shared(data, embedded.size);
+    else
+    {
+        MemoryBuffer buffer(const_cast<char*>(data), size_t(embedded.size));
+        std::istream stream(&buffer);
+        description = load(stream);
+    }
 
     if (description.has_value())
     {
@@ -341,7 +602,9 @@ void Network<Arch, Transformer>::load_internal() {
 
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::initialize() {
-    featureTransformer = make_unique_large_page<Transformer>();
+    mapping.reset();
+    ownedTransformer   = make_unique_large_page<Transformer>();
+    featureTransformer = ownedTransformer.get();
     network            = make_unique_aligned<Arch[]>(LayerStacks);
 }
 
@@ -366,6 +629,149 @@ std::optional<std::string> Network<Arch, Transformer>::load(std::istream& stream
 }
 
 
+// Uses the feature transformer where it is in the file, unless the file was
+// converted by a build that permutes the weights differently. Only the layer
+// stacks, a few hundred KB, are read. The net is unchanged if the file is not
+// a valid raw net.
+template<typename Arch, typename Transformer>
+std::optional<std::string>
+Network<Arch, Transformer>::load_raw(const std::shared_ptr<const MappedFile>& file) {
+    RawHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (header.version != Version || header.hash != Network::hash
+        || header.transformerSize != sizeof(Transformer)
+        || file->size() < RawAlignment + sizeof(Transformer))
+        return std::nullopt;
+
+    std::array<std::size_t, 8> order;
+    std::copy(std::begin(header.order), std::end(header.order), order.begin());
+    if (!std::is_permutation(order.begin(), order.end(), Transformer::PackusEpi16Order.begin(),
+                             Transformer::PackusEpi16Order.end()))
+        return std::nullopt;
+
+    const std::size_t offset = RawAlignment + sizeof(Transformer);
+    MemoryBuffer      buffer(const_cast<char*>(file->data() + offset), file->size() - offset);
+    std::istream      stream(&buffer);
+    std::string       description;
+    std::uint32_t     hashValue;
+    auto              layers = make_unique_aligned<Arch[]>(LayerStacks);
+
+    if (!read_header(stream, &hashValue, &description) || hashValue != Network::hash)
+        return std::nullopt;
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        if (!Detail::read_parameters(stream, layers[i]))
+            return std::nullopt;
+    if (!stream || stream.peek() != std::ios::traits_type::eof())
+        return std::nullopt;
+
+    const auto* fileTransformer = reinterpret_cast<const Transformer*>(file->data() + RawAlignment);
+    network                     = std::move(layers);
+
+    if (order == Transformer::PackusEpi16Order)
+    {
+        ownedTransformer.reset();
+        mapping            = file;
+        featureTransformer = fileTransformer;
+    }
+    else
+    {
+        mapping.reset();
+        ownedTransformer = make_unique_large_page<Transformer>(*fileTransformer);
+        ownedTransformer->repermute_weights(order);
+        featureTransformer = ownedTransformer.get();
+    }
+
+    return description;
+}
+
+
+// Shares the feature transformer of the .nnue net in [data, data + size) with
+// the other processes of the host that load the same net: the first one reads
+// it into a shared memory object, laid out as a raw net, and all of them map
+// the object read-only. The name holds the hash and a checksum of the net and
+// the weight order of the build, so builds that permute the weights
+// differently use different objects. An object whose creator died before it
+// was filled is created again. Reads the net privately when the object cannot
+// be created, is not filled in time, belongs to another user or does not match
+// its checksum.
+template<typename Arch, typename Transformer>
+std::optional<std::string> Network<Arch, Transformer>::load_shared(const char* data,
+                                                                   std::size_t size) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "/nnue-%08x-%016llx-", Network::hash,
+                  static_cast<unsigned long long>(checksum(data, size)));
+    std::string objectName = name;
+    for (std::size_t i : Transformer::PackusEpi16Order)
+        objectName += char('0' + i);
+
+    auto read = [&] {
+        MemoryBuffer buffer(const_cast<char*>(data), size);
+        std::istream stream(&buffer);
+        return load(stream);
+    };
+
+    std::shared_ptr<MappedFile> object;
+    const auto                  start = std::chrono::steady_clock::now();
+    while (!(object = MappedFile::create_shared_memory(objectName)))
+    {
+        // Another process is filling the object, or filled it. An object of
+        // another user is not used.
+        auto shared = MappedFile::open_shared_memory(objectName);
+        if (!shared || std::chrono::steady_clock::now() - start >= SharedMemoryWait)
+            return read();
+        if (is_published(shared))
+        {
+            auto description = is_intact(shared) ? load_raw(shared) : std::nullopt;
+            return description.has_value() ? description : read();
+        }
+        // Its creator died before it published it, take over
+        if (MappedFile::remove_abandoned_shared_memory(objectName))
+            continue;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    auto description = read();
+    if (!description.has_value())
+    {
+        MappedFile::remove_shared_memory(objectName);
+        return description;
+    }
+
+    std::ostringstream tail;
+    write_header(tail, Network::hash, description.value());
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        Detail::write_parameters(tail, network[i]);
+    const std::string layers = tail.str();
+
+    const std::size_t objectSize = RawAlignment + sizeof(Transformer) + layers.size();
+    char*             dst        = object->resize(objectSize) ? object->writable_data() : nullptr;
+    if (!dst)
+    {
+        MappedFile::remove_shared_memory(objectName);
+        return description;
+    }
+
+    // The magic goes last, the other processes wait for it
+    const RawHeader header = make_raw_header(Network::hash, *featureTransformer, layers);
+    const char*     src    = reinterpret_cast<const char*>(&header);
+    std::memcpy(dst + sizeof(header.magic), src + sizeof(header.magic),
+                sizeof(header) - sizeof(header.magic));
+    std::memcpy(dst + RawAlignment, featureTransformer, sizeof(Transformer));
+    std::memcpy(dst + RawAlignment + sizeof(Transformer), layers.data(), layers.size());
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(dst, header.magic, sizeof(header.magic));
+    object->publish();
+    object.reset();
+
+    // Drop the private copy for the shared one
+    auto shared = MappedFile::open_shared_memory(objectName);
+    if (shared && is_published(shared))
+        load_raw(shared);
+    return description;
+}
+
+
 // Read network header
 template<typename Arch, typename Transformer>
 bool Network<Arch, Transformer>::read_header(std::istream&  stream,
@@ -405,7 +811,7 @@ bool Network<Arch, Transformer>::read_parameters(std::istream& stream,
         return false;
     if (hashValue != Network::hash)
         return false;
-    if (!Detail::read_parameters(stream, *featureTransformer))
+    if (!Detail::read_parameters(stream, *ownedTransformer))
         return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
     {
@@ -421,7 +827,11 @@ bool Network<Arch, Transformer>::write_parameters(std::ostream&      stream,
                                                   const std::string& netDescription) const {
     if (!write_header(stream, Network::hash, netDescription))
         return false;
-    if (!Detail::write_parameters(stream, *featureTransformer))
+
+    // Writing undoes the permutation and the scaling in place, and a mapped
+    // feature transformer is read-only
+    auto transformer = make_unique_large_page<Transformer>(*featureTransformer);
+    if (!Detail::write_parameters(stream, *transformer))
         return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
     {
@@ -439,4 +849,5 @@ template class Network<NetworkArchitecture<TransformedFeatureDimensionsBig, L2Bi
 template class Network<NetworkArchitecture<TransformedFeatureDimensionsSmall, L2Small, L3Small>,
                        FeatureTransformer<TransformedFeatureDimensionsSmall>>;
 
+}  // namespace NNUE_ARCH
 }  // namespace Stockfish::Eval::NNUE
@@ -22,16 +22,19 @@
 #include <cstdint>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "../memory.h"
 #include "../types.h"
 #include "nnue_accumulator.h"
 #include "nnue_architecture.h"
+#include "nnue_backend.h"
 #include "nnue_common.h"
 #include "nnue_feature_transformer.h"
 #include "nnue_misc.h"
@@ -41,13 +44,7 @@ class Position;
 }
 
 namespace Stockfish::Eval::NNUE {
-
-enum class EmbeddedNNUEType {
-    BIG,
-    SMALL,
-};
-
-using NetworkOutput = std::tuple<Value, Value>;
+inline namespace NNUE_ARCH {
 
 template<typename Arch, typename Transformer>
 class Network {
@@ -67,10 +64,29 @@ class Network {
     void load(const std::string& rootDirectory, std::string evalfilePath);
     bool save(const std::optional<std::string>& filename) const;
 
+    // Writes the loaded net as a raw net, which load() maps instead of reading
+    bool save_raw(const std::string& filename) const;
+
+    // From the next load() on, .nnue nets go to shared memory, one copy of the
+    // feature transformer per host, see load_shared()
+    void set_shared_memory(bool on) { sharedMemory = on; }
+
+    // Copies a mapped feature transformer into memory of its own
+    void copy_mapping();
+
+    const Transformer& feature_transformer() const { return *featureTransformer; }
+    const Arch&        layer_stack(int bucket) const { return network[bucket]; }
+
     NetworkOutput evaluate(const Position&                         pos,
                            AccumulatorStack&                       accumulatorStack,
                            AccumulatorCaches::Cache<FTDimensions>* cache) const;
 
+    // Evaluates n independent positions, see Backend::evaluate_batch()
+    void evaluate_batch(std::size_t                                  n,
+                        const std::function<Position&(std::size_t)>& position,
+                        AccumulatorCaches::Cache<FTDimensions>*      cache,
+                        NetworkOutput*                               output) const;
+
 
     void verify(std::string evalfilePath, const std::function<void(std::string_view)>&) const;
     NnueEvalTrace trace_evaluate(const Position&                         pos,
@@ -85,6 +101,8 @@ class Network {
 
     bool                       save(std::ostream&, const std::string&, const std::string&) const;
     std::optional<std::string> load(std::istream&);
+    std::optional<std::string> load_raw(const std::shared_ptr<const MappedFile>&);
+    std::optional<std::string> load_shared(const char* data, std::size_t size);
 
     bool read_header(std::istream&, std::uint32_t*, std::string*) const;
     bool write_header(std::ostream&, std::uint32_t, const std::string&) const;
@@ -92,14 +110,18 @@ class Network {
     bool read_parameters(std::istream&, std::string&) const;
     bool write_parameters(std::ostream&, const std::string&) const;
 
-    // Input feature converter
-    LargePagePtr<Transformer> featureTransformer;
+    // Input feature converter, read into ownedTransformer or, for a raw net
+    // and in shared memory, in the mapping
+    const Transformer*                featureTransformer = nullptr;
+    LargePagePtr<Transformer>         ownedTransformer;
+    std::shared_ptr<const MappedFile> mapping;
 
     // Evaluation function
     AlignedPtr<Arch[]> network;
 
     EvalFile         evalFile;
     EmbeddedNNUEType embeddedType;
+    bool             sharedMemory = false;
 
     // Hash value of evaluation function structure
     static constexpr std::uint32_t hash = Transformer::get_hash_value() ^ Arch::get_hash_value();
@@ -131,7 +153,11 @@ struct Networks {
     NetworkSmall small;
 };
 
+// Microbenchmarks of the networks on the given positions, see nnue_bench.cpp
+void bench(const Networks& networks, const std::vector<std::string>& fens, std::ostream& out);
+
 
-}  // namespace Stockfish
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
 
 #endif
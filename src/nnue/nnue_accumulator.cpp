@@ -18,10 +18,12 @@
 
 #include "nnue_accumulator.h"
 
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <initializer_list>
 #include <type_traits>
+#include <utility>
 
 #include "../bitboard.h"
 #include "../misc.h"
@@ -35,6 +37,7 @@ namespace Stockfish::Eval::NNUE {
 
 using namespace SIMD;
 
+inline namespace NNUE_ARCH {
 namespace {
 
 template<Color Perspective, IndexType TransformedFeatureDimensions>
@@ -51,71 +54,100 @@ void update_accumulator_incremental(
   AccumulatorState&                                       target_state,
   const AccumulatorState&                                 computed);
 
+template<IndexType Dimensions>
+void double_inc_update_both(const FeatureTransformer<Dimensions>& featureTransformer,
+                            const std::array<Square, COLOR_NB>&   ksq,
+                            AccumulatorState&                     middle_state,
+                            AccumulatorState&                     target_state,
+                            const AccumulatorState&               computed);
+
+template<IndexType Dimensions>
+void update_accumulator_incremental_both(const FeatureTransformer<Dimensions>& featureTransformer,
+                                         const std::array<Square, COLOR_NB>&   ksq,
+                                         AccumulatorState&                     target_state,
+                                         const AccumulatorState&               computed);
+
 template<Color Perspective, IndexType Dimensions>
 void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& featureTransformer,
                                       const Position&                       pos,
                                       AccumulatorState&                     accumulatorState,
                                       AccumulatorCaches::Cache<Dimensions>& cache);
 
-}
+template<Color Perspective, IndexType Dimensions>
+int refresh_cost(const Position& pos, AccumulatorCaches::Cache<Dimensions>& cache);
 
-void AccumulatorState::reset(const DirtyPiece& dp) noexcept {
-    dirtyPiece = dp;
-    accumulatorBig.computed.fill(false);
-    accumulatorSmall.computed.fill(false);
 }
+}  // namespace NNUE_ARCH
 
-const AccumulatorState& AccumulatorStack::latest() const noexcept { return accumulators[size - 1]; }
+template<typename FeatureTransformer>
+void AccumulatorStack::evaluate(
+  const Position&                                                 pos,
+  const FeatureTransformer&                                       featureTransformer,
+  AccumulatorCaches::Cache<FeatureTransformer::OutputDimensions>& cache) noexcept {
 
-AccumulatorState& AccumulatorStack::mut_latest() noexcept { return accumulators[size - 1]; }
+    constexpr IndexType Dimensions = FeatureTransformer::OutputDimensions;
 
-void AccumulatorStack::reset() noexcept {
-    accumulators[0].reset({});
-    size = 1;
-}
+    stats.net<Dimensions>().evaluations++;
 
-void AccumulatorStack::push(const DirtyPiece& dirtyPiece) noexcept {
-    assert(size + 1 < accumulators.size());
-    accumulators[size].reset(dirtyPiece);
-    size++;
-}
+    const auto white = find_last_usable_accumulator<WHITE, FeatureTransformer>();
+    const auto black = find_last_usable_accumulator<BLACK, FeatureTransformer>();
 
-void AccumulatorStack::pop() noexcept {
-    assert(size > 1);
-    size--;
-}
-
-template<IndexType Dimensions>
-void AccumulatorStack::evaluate(const Position&                       pos,
-                                const FeatureTransformer<Dimensions>& featureTransformer,
-                                AccumulatorCaches::Cache<Dimensions>& cache) noexcept {
+    // Without a king move since the last computed accumulator, the usual case,
+    // both sides are updated from it in one pass
+    const auto& computed = (accumulators[white].template acc<Dimensions>()).computed;
+    if (white == black && computed[WHITE] && computed[BLACK]
+        && update_cost(white) <= refresh_cost<WHITE>(pos, cache)
+        && update_cost(white) <= refresh_cost<BLACK>(pos, cache))
+    {
+        forward_update_incremental_both(pos, featureTransformer, white);
+        return;
+    }
 
-    evaluate_side<WHITE>(pos, featureTransformer, cache);
-    evaluate_side<BLACK>(pos, featureTransformer, cache);
+    evaluate_side<WHITE>(pos, featureTransformer, cache, white);
+    evaluate_side<BLACK>(pos, featureTransformer, cache, black);
 }
 
-template<Color Perspective, IndexType Dimensions>
-void AccumulatorStack::evaluate_side(const Position&                       pos,
-                                     const FeatureTransformer<Dimensions>& featureTransformer,
-                                     AccumulatorCaches::Cache<Dimensions>& cache) noexcept {
+template<Color Perspective, typename FeatureTransformer>
+void AccumulatorStack::evaluate_side(
+  const Position&                                                 pos,
+  const FeatureTransformer&                                       featureTransformer,
+  AccumulatorCaches::Cache<FeatureTransformer::OutputDimensions>& cache,
+  const std::size_t                                               last_usable_accum) noexcept {
 
-    const auto last_usable_accum = find_last_usable_accumulator<Perspective, Dimensions>();
+    constexpr IndexType Dimensions = FeatureTransformer::OutputDimensions;
 
     if ((accumulators[last_usable_accum].template acc<Dimensions>()).computed[Perspective])
-        forward_update_incremental<Perspective>(pos, featureTransformer, last_usable_accum);
+    {
+        // Far from the last computed accumulator (the first evaluation in a new
+        // subtree), the cache entry of the king square is often closer to the
+        // position than the accumulator is. The plies in between then stay
+        // uncomputed, a later evaluation only computes them if it needs them.
+        if (update_cost(last_usable_accum) <= refresh_cost<Perspective>(pos, cache))
+            forward_update_incremental<Perspective>(pos, featureTransformer, last_usable_accum);
+        else
+        {
+            update_accumulator_refresh_cache<Perspective>(featureTransformer, pos, mut_latest(),
+                                                          cache);
+            stats.net<Dimensions>().refreshes++;
+            stats.net<Dimensions>().shortcuts++;
+        }
+    }
 
     else
     {
         update_accumulator_refresh_cache<Perspective>(featureTransformer, pos, mut_latest(), cache);
+        stats.net<Dimensions>().refreshes++;
         backward_update_incremental<Perspective>(pos, featureTransformer, last_usable_accum);
     }
 }
 
 // Find the earliest usable accumulator, this can either be a computed accumulator or the accumulator
 // state just before a change that requires full refresh.
-template<Color Perspective, IndexType Dimensions>
+template<Color Perspective, typename FeatureTransformer>
 std::size_t AccumulatorStack::find_last_usable_accumulator() const noexcept {
 
+    constexpr IndexType Dimensions = FeatureTransformer::OutputDimensions;
+
     for (std::size_t curr_idx = size - 1; curr_idx > 0; curr_idx--)
     {
         if ((accumulators[curr_idx].template acc<Dimensions>()).computed[Perspective])
@@ -128,11 +160,12 @@ std::size_t AccumulatorStack::find_last_usable_accumulator() const noexcept {
     return 0;
 }
 
-template<Color Perspective, IndexType Dimensions>
-void AccumulatorStack::forward_update_incremental(
-  const Position&                       pos,
-  const FeatureTransformer<Dimensions>& featureTransformer,
-  const std::size_t                     begin) noexcept {
+template<Color Perspective, typename FeatureTransformer>
+void AccumulatorStack::forward_update_incremental(const Position&           pos,
+                                                  const FeatureTransformer& featureTransformer,
+                                                  const std::size_t         begin) noexcept {
+
+    constexpr IndexType Dimensions = FeatureTransformer::OutputDimensions;
 
     assert(begin < accumulators.size());
     assert((accumulators[begin].acc<Dimensions>()).computed[Perspective]);
@@ -153,6 +186,7 @@ void AccumulatorStack::forward_update_incremental(
                 double_inc_update<Perspective>(featureTransformer, ksq, accumulators[next],
                                                accumulators[next + 1], accumulators[next - 1]);
                 dp1.to = dp2.remove_sq = captureSq;
+                stats.net<Dimensions>().updates++;
 
                 next++;
                 continue;
@@ -160,16 +194,60 @@ void AccumulatorStack::forward_update_incremental(
         }
         update_accumulator_incremental<Perspective, true>(
           featureTransformer, ksq, accumulators[next], accumulators[next - 1]);
+        stats.net<Dimensions>().updates++;
     }
 
     assert((latest().acc<Dimensions>()).computed[Perspective]);
 }
 
-template<Color Perspective, IndexType Dimensions>
-void AccumulatorStack::backward_update_incremental(
-  const Position&                       pos,
-  const FeatureTransformer<Dimensions>& featureTransformer,
-  const std::size_t                     end) noexcept {
+template<typename FeatureTransformer>
+void AccumulatorStack::forward_update_incremental_both(const Position&           pos,
+                                                       const FeatureTransformer& featureTransformer,
+                                                       const std::size_t         begin) noexcept {
+
+    constexpr IndexType Dimensions = FeatureTransformer::OutputDimensions;
+
+    assert(begin < accumulators.size());
+    assert((accumulators[begin].acc<Dimensions>()).computed[WHITE]);
+    assert((accumulators[begin].acc<Dimensions>()).computed[BLACK]);
+
+    const std::array<Square, COLOR_NB> ksq = {pos.square<KING>(WHITE), pos.square<KING>(BLACK)};
+
+    for (std::size_t next = begin + 1; next < size; next++)
+    {
+        if (next + 1 < size)
+        {
+            DirtyPiece& dp1 = accumulators[next].dirtyPiece;
+            DirtyPiece& dp2 = accumulators[next + 1].dirtyPiece;
+
+            if (dp1.to != SQ_NONE && dp1.to == dp2.remove_sq)
+            {
+                const Square captureSq = dp1.to;
+                dp1.to = dp2.remove_sq = SQ_NONE;
+                double_inc_update_both(featureTransformer, ksq, accumulators[next],
+                                       accumulators[next + 1], accumulators[next - 1]);
+                dp1.to = dp2.remove_sq = captureSq;
+                stats.net<Dimensions>().updates += 2;
+
+                next++;
+                continue;
+            }
+        }
+        update_accumulator_incremental_both(featureTransformer, ksq, accumulators[next],
+                                            accumulators[next - 1]);
+        stats.net<Dimensions>().updates += 2;
+    }
+
+    assert((latest().acc<Dimensions>()).computed[WHITE]);
+    assert((latest().acc<Dimensions>()).computed[BLACK]);
+}
+
+template<Color Perspective, typename FeatureTransformer>
+void AccumulatorStack::backward_update_incremental(const Position&           pos,
+                                                   const FeatureTransformer& featureTransformer,
+                                                   const std::size_t         end) noexcept {
+
+    constexpr IndexType Dimensions = FeatureTransformer::OutputDimensions;
 
     assert(end < accumulators.size());
     assert(end < size);
@@ -180,21 +258,24 @@ void AccumulatorStack::backward_update_incremental(
     for (std::int64_t next = std::int64_t(size) - 2; next >= std::int64_t(end); next--)
         update_accumulator_incremental<Perspective, false>(
           featureTransformer, ksq, accumulators[next], accumulators[next + 1]);
+    stats.net<Dimensions>().updates += size - 1 - end;
 
     assert((accumulators[end].acc<Dimensions>()).computed[Perspective]);
 }
 
-// Explicit template instantiations
-template void AccumulatorStack::evaluate<TransformedFeatureDimensionsBig>(
+// Explicit template instantiations, for the feature transformers of this
+// instruction set
+template void AccumulatorStack::evaluate<FeatureTransformer<TransformedFeatureDimensionsBig>>(
   const Position&                                            pos,
   const FeatureTransformer<TransformedFeatureDimensionsBig>& featureTransformer,
   AccumulatorCaches::Cache<TransformedFeatureDimensionsBig>& cache) noexcept;
-template void AccumulatorStack::evaluate<TransformedFeatureDimensionsSmall>(
+template void AccumulatorStack::evaluate<FeatureTransformer<TransformedFeatureDimensionsSmall>>(
   const Position&                                              pos,
   const FeatureTransformer<TransformedFeatureDimensionsSmall>& featureTransformer,
   AccumulatorCaches::Cache<TransformedFeatureDimensionsSmall>& cache) noexcept;
 
 
+inline namespace NNUE_ARCH {
 namespace {
 
 template<typename VectorWrapper,
@@ -249,6 +330,74 @@ struct AccumulatorUpdateContext {
     }
 };
 
+// Both sides in one pass: moves that do not move a king change the same
+// features for both, at different indices. Each vector of the accumulators
+// and of the psqt accumulators is loaded, updated and stored once. The sides
+// alternate by tiles of 16 vectors: interleaving them vector by vector was
+// slower than one side after the other, tiles keep the loads of both sides'
+// weight rows in flight without that.
+template<IndexType Dimensions, std::size_t N>
+struct BothSidesUpdateContext {
+    const FeatureTransformer<Dimensions>&               featureTransformer;
+    const AccumulatorState&                             from;
+    AccumulatorState&                                   to;
+    std::array<std::array<IndexType, N>, COLOR_NB>      indices;
+
+    template<UpdateOperation... ops>
+    void apply() {
+        static_assert(sizeof...(ops) == N);
+        apply<ops...>(std::make_index_sequence<N>());
+    }
+
+   private:
+    template<UpdateOperation... ops, std::size_t... I>
+    void apply(std::index_sequence<I...>) {
+        using Vec     = typename Vec16Wrapper::type;
+        using PsqtVec = typename Vec32Wrapper::type;
+
+        constexpr IndexType Size     = Dimensions * sizeof(BiasType) / sizeof(Vec);
+        constexpr IndexType PsqtSize = PSQTBuckets * sizeof(PSQTWeightType) / sizeof(PsqtVec);
+
+        const auto& in  = from.acc<Dimensions>();
+        auto&       out = to.acc<Dimensions>();
+
+        const Vec* inW  = reinterpret_cast<const Vec*>(in.accumulation[WHITE]);
+        const Vec* inB  = reinterpret_cast<const Vec*>(in.accumulation[BLACK]);
+        Vec*       outW = reinterpret_cast<Vec*>(out.accumulation[WHITE]);
+        Vec*       outB = reinterpret_cast<Vec*>(out.accumulation[BLACK]);
+
+        const Vec* rowsW[] = {reinterpret_cast<const Vec*>(
+          &featureTransformer.weights[indices[WHITE][I] * Dimensions])...};
+        const Vec* rowsB[] = {reinterpret_cast<const Vec*>(
+          &featureTransformer.weights[indices[BLACK][I] * Dimensions])...};
+
+        constexpr IndexType Tile = Size % 16 == 0 ? 16 : Size;
+        for (IndexType j = 0; j < Size; j += Tile)
+        {
+            for (IndexType i = j; i < j + Tile; ++i)
+                outW[i] = fused<Vec16Wrapper, ops...>(inW[i], rowsW[I][i]...);
+            for (IndexType i = j; i < j + Tile; ++i)
+                outB[i] = fused<Vec16Wrapper, ops...>(inB[i], rowsB[I][i]...);
+        }
+
+        const PsqtVec* psqtInW  = reinterpret_cast<const PsqtVec*>(in.psqtAccumulation[WHITE]);
+        const PsqtVec* psqtInB  = reinterpret_cast<const PsqtVec*>(in.psqtAccumulation[BLACK]);
+        PsqtVec*       psqtOutW = reinterpret_cast<PsqtVec*>(out.psqtAccumulation[WHITE]);
+        PsqtVec*       psqtOutB = reinterpret_cast<PsqtVec*>(out.psqtAccumulation[BLACK]);
+
+        const PsqtVec* psqtRowsW[] = {reinterpret_cast<const PsqtVec*>(
+          &featureTransformer.psqtWeights[indices[WHITE][I] * PSQTBuckets])...};
+        const PsqtVec* psqtRowsB[] = {reinterpret_cast<const PsqtVec*>(
+          &featureTransformer.psqtWeights[indices[BLACK][I] * PSQTBuckets])...};
+
+        for (IndexType i = 0; i < PsqtSize; ++i)
+        {
+            psqtOutW[i] = fused<Vec32Wrapper, ops...>(psqtInW[i], psqtRowsW[I][i]...);
+            psqtOutB[i] = fused<Vec32Wrapper, ops...>(psqtInB[i], psqtRowsB[I][i]...);
+        }
+    }
+};
+
 template<Color Perspective, IndexType Dimensions>
 auto make_accumulator_update_context(const FeatureTransformer<Dimensions>& featureTransformer,
                                      const AccumulatorState&               accumulatorFrom,
@@ -362,6 +511,121 @@ void update_accumulator_incremental(
     (target_state.acc<TransformedFeatureDimensions>()).computed[Perspective] = true;
 }
 
+template<IndexType Dimensions>
+void double_inc_update_both(const FeatureTransformer<Dimensions>& featureTransformer,
+                            const std::array<Square, COLOR_NB>&   ksq,
+                            AccumulatorState&                     middle_state,
+                            AccumulatorState&                     target_state,
+                            const AccumulatorState&               computed) {
+
+    assert(!middle_state.acc<Dimensions>().computed[WHITE]);
+    assert(!target_state.acc<Dimensions>().computed[WHITE]);
+
+    FeatureSet::IndexList removed[COLOR_NB], added[COLOR_NB];
+    FeatureSet::append_changed_indices<WHITE>(ksq[WHITE], middle_state.dirtyPiece,
+                                              removed[WHITE], added[WHITE]);
+    FeatureSet::append_changed_indices<WHITE>(ksq[WHITE], target_state.dirtyPiece,
+                                              removed[WHITE], added[WHITE]);
+    FeatureSet::append_changed_indices<BLACK>(ksq[BLACK], middle_state.dirtyPiece,
+                                              removed[BLACK], added[BLACK]);
+    FeatureSet::append_changed_indices<BLACK>(ksq[BLACK], target_state.dirtyPiece,
+                                              removed[BLACK], added[BLACK]);
+
+    assert(added[WHITE].size() == 1 && added[BLACK].size() == 1);
+    assert(removed[WHITE].size() == removed[BLACK].size());
+    assert(removed[WHITE].size() == 2 || removed[WHITE].size() == 3);
+
+    sf_assume(added[WHITE].size() == 1 && added[BLACK].size() == 1);
+    sf_assume(removed[WHITE].size() == 2 || removed[WHITE].size() == 3);
+
+    if (removed[WHITE].size() == 2)
+        BothSidesUpdateContext<Dimensions, 3>{
+          featureTransformer,
+          computed,
+          target_state,
+          {{{added[WHITE][0], removed[WHITE][0], removed[WHITE][1]},
+            {added[BLACK][0], removed[BLACK][0], removed[BLACK][1]}}}}
+          .template apply<Add, Sub, Sub>();
+    else
+        BothSidesUpdateContext<Dimensions, 4>{
+          featureTransformer,
+          computed,
+          target_state,
+          {{{added[WHITE][0], removed[WHITE][0], removed[WHITE][1], removed[WHITE][2]},
+            {added[BLACK][0], removed[BLACK][0], removed[BLACK][1], removed[BLACK][2]}}}}
+          .template apply<Add, Sub, Sub, Sub>();
+
+    target_state.acc<Dimensions>().computed.fill(true);
+}
+
+template<IndexType Dimensions>
+void update_accumulator_incremental_both(const FeatureTransformer<Dimensions>& featureTransformer,
+                                         const std::array<Square, COLOR_NB>&   ksq,
+                                         AccumulatorState&                     target_state,
+                                         const AccumulatorState&               computed) {
+
+    assert(!target_state.acc<Dimensions>().computed[WHITE]);
+
+    FeatureSet::IndexList removed[COLOR_NB], added[COLOR_NB];
+    FeatureSet::append_changed_indices<WHITE>(ksq[WHITE], target_state.dirtyPiece,
+                                              removed[WHITE], added[WHITE]);
+    FeatureSet::append_changed_indices<BLACK>(ksq[BLACK], target_state.dirtyPiece,
+                                              removed[BLACK], added[BLACK]);
+
+    assert(added[WHITE].size() == added[BLACK].size());
+    assert(removed[WHITE].size() == removed[BLACK].size());
+    assert(added[WHITE].size() == 1 || added[WHITE].size() == 2);
+    assert(removed[WHITE].size() == 1 || removed[WHITE].size() == 2);
+
+    sf_assume(added[WHITE].size() == 1 || added[WHITE].size() == 2);
+    sf_assume(removed[WHITE].size() == 1 || removed[WHITE].size() == 2);
+
+    const auto& aW = added[WHITE];
+    const auto& rW = removed[WHITE];
+    const auto& aB = added[BLACK];
+    const auto& rB = removed[BLACK];
+
+    // A quiet move, a capture, a promotion, a capturing promotion
+    if (rW.size() == 1)
+        BothSidesUpdateContext<Dimensions, 2>{
+          featureTransformer, computed, target_state, {{{aW[0], rW[0]}, {aB[0], rB[0]}}}}
+          .template apply<Add, Sub>();
+    else if (aW.size() == 1)
+        BothSidesUpdateContext<Dimensions, 3>{featureTransformer,
+                                              computed,
+                                              target_state,
+                                              {{{aW[0], rW[0], rW[1]}, {aB[0], rB[0], rB[1]}}}}
+          .template apply<Add, Sub, Sub>();
+    else
+        BothSidesUpdateContext<Dimensions, 4>{
+          featureTransformer,
+          computed,
+          target_state,
+          {{{aW[0], aW[1], rW[0], rW[1]}, {aB[0], aB[1], rB[0], rB[1]}}}}
+          .template apply<Add, Add, Sub, Sub>();
+
+    target_state.acc<Dimensions>().computed.fill(true);
+}
+
+// Rows read or written to refresh from the cache, in the units of
+// AccumulatorStack::update_cost(): the weights of each feature that differs
+// from the cache entry, plus a fixed overhead. The entry is read and written
+// and the accumulator written, but a refresh also leaves the plies before it
+// uncomputed, which their next evaluation pays for. 12 gives the fewest
+// weight rows in bench, 3 (the passes alone) more than never refreshing.
+template<Color Perspective, IndexType Dimensions>
+int refresh_cost(const Position& pos, AccumulatorCaches::Cache<Dimensions>& cache) {
+
+    const auto& entry = cache[pos.square<KING>(Perspective)][Perspective];
+    int         cost  = 12;
+
+    for (Color c : {WHITE, BLACK})
+        for (PieceType pt = PAWN; pt <= KING; ++pt)
+            cost += popcount((entry.byColorBB[c] & entry.byTypeBB[pt]) ^ pos.pieces(c, pt));
+
+    return cost;
+}
+
 template<Color Perspective, IndexType Dimensions>
 void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& featureTransformer,
                                       const Position&                       pos,
@@ -526,6 +790,6 @@ void update_accumulator_refresh_cache(const FeatureTransformer<Dimensions>& feat
         entry.byTypeBB[pt] = pos.pieces(pt);
 }
 
-}
-
-}
+}  // namespace
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
@@ -22,27 +22,27 @@
 #define NNUE_ACCUMULATOR_H_INCLUDED
 
 #include <array>
+#include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <vector>
 
 #include "../types.h"
-#include "nnue_architecture.h"
 #include "nnue_common.h"
 
 namespace Stockfish {
 class Position;
 }
 
+// The accumulators are plain data, the same for every instruction set. The code
+// that updates them is compiled with the feature transformer of each one (the
+// member templates below), see nnue_common.h.
 namespace Stockfish::Eval::NNUE {
 
 template<IndexType Size>
 struct alignas(CacheLineSize) Accumulator;
 
-template<IndexType TransformedFeatureDimensions>
-class FeatureTransformer;
-
 // Class that holds the result of affine transformation of input features
 template<IndexType Size>
 struct alignas(CacheLineSize) Accumulator {
@@ -107,6 +107,59 @@ struct AccumulatorCaches {
 };
 
 
+// Feature transformer work of an AccumulatorStack, for bench. push() only
+// records the move, accumulators are computed by evaluate() alone and only
+// for the network evaluated: a position that is never evaluated (TT cutoff,
+// draw, pruned move) costs nothing, and the big network nothing where only the
+// small one is evaluated, unless a later evaluation of that network passes
+// through the position on the way to its own.
+struct AccumulatorStats {
+    struct Network {
+        std::uint64_t evaluations = 0;  // evaluate() calls
+        std::uint64_t untouched   = 0;  // Moves undone without this network's accumulator computed
+        std::uint64_t updates     = 0;  // Accumulators of one side computed from a neighbour ply
+        std::uint64_t refreshes   = 0;  // Accumulators of one side computed from the cache
+        std::uint64_t shortcuts   = 0;  // Refreshes done because the updates would cost more
+
+        Network& operator+=(const Network& o) noexcept {
+            evaluations += o.evaluations;
+            untouched += o.untouched;
+            updates += o.updates;
+            refreshes += o.refreshes;
+            shortcuts += o.shortcuts;
+            return *this;
+        }
+    };
+
+    std::uint64_t pushes    = 0;  // Moves made
+    std::uint64_t untouched = 0;  // Moves undone without any accumulator computed
+    std::uint64_t fallbacks = 0;  // Small network evaluations redone with the big one,
+                                  // counted by Eval::evaluate()
+    Network       big, small;
+
+    AccumulatorStats& operator+=(const AccumulatorStats& o) noexcept {
+        pushes += o.pushes;
+        untouched += o.untouched;
+        fallbacks += o.fallbacks;
+        big += o.big;
+        small += o.small;
+        return *this;
+    }
+
+    template<IndexType Size>
+    Network& net() noexcept {
+        static_assert(Size == TransformedFeatureDimensionsBig
+                        || Size == TransformedFeatureDimensionsSmall,
+                      "Invalid size for accumulator");
+
+        if constexpr (Size == TransformedFeatureDimensionsBig)
+            return big;
+        else
+            return small;
+    }
+};
+
+
 struct AccumulatorState {
     Accumulator<TransformedFeatureDimensionsBig>   accumulatorBig;
     Accumulator<TransformedFeatureDimensionsSmall> accumulatorSmall;
@@ -136,7 +189,12 @@ struct AccumulatorState {
             return accumulatorSmall;
     }
 
-    void reset(const DirtyPiece& dp) noexcept;
+    void reset(const DirtyPiece& dp) noexcept {
+        dirtyPiece = dp;
+        accumulatorBig.computed.fill(false);
+        accumulatorSmall.computed.fill(false);
+    }
+
 };
 
 
@@ -146,37 +204,82 @@ class AccumulatorStack {
         accumulators(MAX_PLY + 1),
         size{1} {}
 
-    [[nodiscard]] const AccumulatorState& latest() const noexcept;
+    [[nodiscard]] const AccumulatorState& latest() const noexcept {
+        return accumulators[size - 1];
+    }
 
-    void reset() noexcept;
-    void push(const DirtyPiece& dirtyPiece) noexcept;
-    void pop() noexcept;
+    void reset() noexcept {
+        accumulators[0].reset({});
+        size = 1;
+    }
 
-    template<IndexType Dimensions>
-    void evaluate(const Position&                       pos,
-                  const FeatureTransformer<Dimensions>& featureTransformer,
-                  AccumulatorCaches::Cache<Dimensions>& cache) noexcept;
+    void push(const DirtyPiece& dirtyPiece) noexcept {
+        assert(size + 1 < accumulators.size());
+        accumulators[size].reset(dirtyPiece);
+        size++;
+        stats.pushes++;
+    }
+
+    void pop() noexcept {
+        assert(size > 1);
+        size--;
+        const AccumulatorState& st = accumulators[size];
+        const bool big   = st.accumulatorBig.computed[WHITE] || st.accumulatorBig.computed[BLACK];
+        const bool small = st.accumulatorSmall.computed[WHITE] || st.accumulatorSmall.computed[BLACK];
+        stats.big.untouched += !big;
+        stats.small.untouched += !small;
+        stats.untouched += !big && !small;
+    }
+
+    template<typename FeatureTransformer>
+    void evaluate(const Position&                                                 pos,
+                  const FeatureTransformer&                                       featureTransformer,
+                  AccumulatorCaches::Cache<FeatureTransformer::OutputDimensions>& cache) noexcept;
+
+    // Not reset by reset(), the owner decides what it counts over
+    AccumulatorStats stats;
 
    private:
-    [[nodiscard]] AccumulatorState& mut_latest() noexcept;
+    [[nodiscard]] AccumulatorState& mut_latest() noexcept { return accumulators[size - 1]; }
 
-    template<Color Perspective, IndexType Dimensions>
-    void evaluate_side(const Position&                       pos,
-                       const FeatureTransformer<Dimensions>& featureTransformer,
-                       AccumulatorCaches::Cache<Dimensions>& cache) noexcept;
+    template<Color Perspective, typename FeatureTransformer>
+    void evaluate_side(const Position&                                                 pos,
+                       const FeatureTransformer&                                       featureTransformer,
+                       AccumulatorCaches::Cache<FeatureTransformer::OutputDimensions>& cache,
+                       std::size_t last_usable_accum) noexcept;
 
-    template<Color Perspective, IndexType Dimensions>
+    template<Color Perspective, typename FeatureTransformer>
     [[nodiscard]] std::size_t find_last_usable_accumulator() const noexcept;
 
-    template<Color Perspective, IndexType Dimensions>
-    void forward_update_incremental(const Position&                       pos,
-                                    const FeatureTransformer<Dimensions>& featureTransformer,
-                                    const std::size_t                     begin) noexcept;
+    // Rows read or written to update from the accumulator at begin to the
+    // latest one: the weights of each changed feature, and the accumulators
+    // of each ply, read and written
+    [[nodiscard]] int update_cost(std::size_t begin) const noexcept {
+        int cost = 0;
+        for (std::size_t idx = begin + 1; idx < size; idx++)
+        {
+            const DirtyPiece& dp = accumulators[idx].dirtyPiece;
+            cost += 3 + (dp.to != SQ_NONE) + (dp.remove_sq != SQ_NONE) + (dp.add_sq != SQ_NONE);
+        }
+        return cost;
+    }
 
-    template<Color Perspective, IndexType Dimensions>
-    void backward_update_incremental(const Position&                       pos,
-                                     const FeatureTransformer<Dimensions>& featureTransformer,
-                                     const std::size_t                     end) noexcept;
+    template<Color Perspective, typename FeatureTransformer>
+    void forward_update_incremental(const Position&           pos,
+                                    const FeatureTransformer& featureTransformer,
+                                    const std::size_t         begin) noexcept;
+
+    // Both sides at once, from an accumulator computed for both and without a
+    // king move after it
+    template<typename FeatureTransformer>
+    void forward_update_incremental_both(const Position&           pos,
+                                         const FeatureTransformer& featureTransformer,
+                                         const std::size_t         begin) noexcept;
+
+    template<Color Perspective, typename FeatureTransformer>
+    void backward_update_incremental(const Position&           pos,
+                                     const FeatureTransformer& featureTransformer,
+                                     const std::size_t         end) noexcept;
 
     std::vector<AccumulatorState> accumulators;
     std::size_t                   size;
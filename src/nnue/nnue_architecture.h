@@ -21,6 +21,8 @@
 #ifndef NNUE_ARCHITECTURE_H_INCLUDED
 #define NNUE_ARCHITECTURE_H_INCLUDED
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iosfwd>
@@ -33,28 +35,11 @@
 #include "nnue_common.h"
 
 namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
 
 // Input features used in evaluation function
 using FeatureSet = Features::HalfKAv2_hm;
 
-// Number of input feature dimensions after conversion
-constexpr IndexType TransformedFeatureDimensionsBig = 3072;
-constexpr int       L2Big                           = 15;
-constexpr int       L3Big                           = 32;
-
-constexpr IndexType TransformedFeatureDimensionsSmall = 128;
-constexpr int       L2Small                           = 15;
-constexpr int       L3Small                           = 32;
-
-constexpr IndexType PSQTBuckets = 8;
-constexpr IndexType LayerStacks = 8;
-
-// If vector instructions are enabled, we update and refresh the
-// accumulator tile by tile such that each tile fits in the CPU's
-// vector registers.
-static_assert(PSQTBuckets % 8 == 0,
-              "Per feature PSQT values cannot be processed at granularity lower than 8 at a time.");
-
 template<IndexType L1, int L2, int L3>
 struct NetworkArchitecture {
     static constexpr IndexType TransformedFeatureDimensions = L1;
@@ -97,19 +82,22 @@ struct NetworkArchitecture {
             && fc_2.write_parameters(stream);
     }
 
-    std::int32_t propagate(const TransformedFeatureType* transformedFeatures) {
-        struct alignas(CacheLineSize) Buffer {
-            alignas(CacheLineSize) typename decltype(fc_0)::OutputBuffer fc_0_out;
-            alignas(CacheLineSize) typename decltype(ac_sqr_0)::OutputType
-              ac_sqr_0_out[ceil_to_multiple<IndexType>(FC_0_OUTPUTS * 2, 32)];
-            alignas(CacheLineSize) typename decltype(ac_0)::OutputBuffer ac_0_out;
-            alignas(CacheLineSize) typename decltype(fc_1)::OutputBuffer fc_1_out;
-            alignas(CacheLineSize) typename decltype(ac_1)::OutputBuffer ac_1_out;
-            alignas(CacheLineSize) typename decltype(fc_2)::OutputBuffer fc_2_out;
-
-            Buffer() { std::memset(this, 0, sizeof(*this)); }
-        };
+    struct alignas(CacheLineSize) Buffer {
+        alignas(CacheLineSize) typename decltype(fc_0)::OutputBuffer fc_0_out;
+        alignas(CacheLineSize) typename decltype(ac_sqr_0)::OutputType
+          ac_sqr_0_out[ceil_to_multiple<IndexType>(FC_0_OUTPUTS * 2, 32)];
+        alignas(CacheLineSize) typename decltype(ac_0)::OutputBuffer ac_0_out;
+        alignas(CacheLineSize) typename decltype(fc_1)::OutputBuffer fc_1_out;
+        alignas(CacheLineSize) typename decltype(ac_1)::OutputBuffer ac_1_out;
+        alignas(CacheLineSize) typename decltype(fc_2)::OutputBuffer fc_2_out;
 
+        Buffer() { std::memset(this, 0, sizeof(*this)); }
+    };
+
+    // Most inputs propagate_batch() takes at once
+    static constexpr std::size_t MaxBatch = 64;
+
+    std::int32_t propagate(const TransformedFeatureType* transformedFeatures) {
 #if defined(__clang__) && (__APPLE__)
         // workaround for a bug reported with xcode 12
         static thread_local auto tlsBuffer = std::make_unique<Buffer>();
@@ -128,16 +116,56 @@ struct NetworkArchitecture {
         ac_1.propagate(buffer.fc_1_out, buffer.ac_1_out);
         fc_2.propagate(buffer.ac_1_out, buffer.fc_2_out);
 
+        return output_value(buffer);
+    }
+
+    // Same results as propagate() on each of the n <= MaxBatch inputs, but one
+    // layer at a time for all of them, so that the weights of a layer are
+    // loaded once per batch rather than once per input.
+    void propagate_batch(const TransformedFeatureType* const* transformedFeatures,
+                         std::size_t                          n,
+                         std::int32_t*                        output) {
+        assert(n <= MaxBatch);
+
+#if defined(__clang__) && (__APPLE__)
+        static thread_local auto tlsBuffers = std::make_unique<Buffer[]>(MaxBatch);
+        Buffer*                  buffers    = tlsBuffers.get();
+#else
+        alignas(CacheLineSize) static thread_local Buffer buffers[MaxBatch];
+#endif
+
+        for (std::size_t i = 0; i < n; ++i)
+            fc_0.propagate(transformedFeatures[i], buffers[i].fc_0_out);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Buffer& buffer = buffers[i];
+            ac_sqr_0.propagate(buffer.fc_0_out, buffer.ac_sqr_0_out);
+            ac_0.propagate(buffer.fc_0_out, buffer.ac_0_out);
+            std::memcpy(buffer.ac_sqr_0_out + FC_0_OUTPUTS, buffer.ac_0_out,
+                        FC_0_OUTPUTS * sizeof(typename decltype(ac_0)::OutputType));
+        }
+        for (std::size_t i = 0; i < n; ++i)
+            fc_1.propagate(buffers[i].ac_sqr_0_out, buffers[i].fc_1_out);
+        for (std::size_t i = 0; i < n; ++i)
+            ac_1.propagate(buffers[i].fc_1_out, buffers[i].ac_1_out);
+        for (std::size_t i = 0; i < n; ++i)
+            fc_2.propagate(buffers[i].ac_1_out, buffers[i].fc_2_out);
+
+        for (std::size_t i = 0; i < n; ++i)
+            output[i] = output_value(buffers[i]);
+    }
+
+   private:
+    static std::int32_t output_value(const Buffer& buffer) {
         // buffer.fc_0_out[FC_0_OUTPUTS] is such that 1.0 is equal to 127*(1<<WeightScaleBits) in
         // quantized form, but we want 1.0 to be equal to 600*OutputScale
         std::int32_t fwdOut =
           (buffer.fc_0_out[FC_0_OUTPUTS]) * (600 * OutputScale) / (127 * (1 << WeightScaleBits));
-        std::int32_t outputValue = buffer.fc_2_out[0] + fwdOut;
-
-        return outputValue;
+        return buffer.fc_2_out[0] + fwdOut;
     }
 };
 
+}  // namespace NNUE_ARCH
 }  // namespace Stockfish::Eval::NNUE
 
 #endif  // #ifndef NNUE_ARCHITECTURE_H_INCLUDED
@@ -0,0 +1,188 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Backend for the instruction set this file is compiled for. Also included by
+// the files in nnue/arch/ for runtime dispatch.
+
+#include "nnue_backend.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "../evaluate.h"
+#include "network.h"
+#include "nnue_accumulator.h"
+
+#define NNUE_CONCAT_(a, b) a##b
+#define NNUE_CONCAT(a, b) NNUE_CONCAT_(a, b)
+
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+
+namespace {
+
+constexpr const char* arch_name() {
+#if defined(USE_AVX512) && defined(USE_VNNI)
+    return "vnni512";
+#elif defined(USE_AVX512)
+    return "avx512";
+#elif defined(USE_AVX2) && defined(USE_AVXVNNI)
+    return "avxvnni";
+#elif defined(USE_AVX2) && defined(USE_VNNI)
+    return "vnni256";
+#elif defined(USE_AVX2)
+    return "avx2";
+#elif defined(USE_SSE41)
+    return "sse41";
+#elif defined(USE_SSSE3)
+    return "ssse3";
+#elif defined(USE_SSE2)
+    return "sse2";
+#elif defined(USE_NEON_DOTPROD)
+    return "neon-dotprod";
+#elif defined(USE_NEON)
+    return "neon";
+#else
+    return "generic";
+#endif
+}
+
+class BackendImpl final: public Backend {
+   public:
+    BackendImpl() :
+        networks(NetworkBig({EvalFileDefaultNameBig, "", EvalFileDefaultNameBig},
+                            EmbeddedNNUEType::BIG),
+                 NetworkSmall({EvalFileDefaultNameSmall, "", EvalFileDefaultNameSmall},
+                              EmbeddedNNUEType::SMALL)) {}
+
+    const char* arch() const override { return arch_name(); }
+
+    void load(EmbeddedNNUEType   type,
+              const std::string& rootDirectory,
+              const std::string& evalfilePath) override {
+        if (type == EmbeddedNNUEType::BIG)
+        {
+            networks.big.load(rootDirectory, evalfilePath);
+            loadedBig = {rootDirectory, evalfilePath};
+        }
+        else
+        {
+            networks.small.load(rootDirectory, evalfilePath);
+            loadedSmall = {rootDirectory, evalfilePath};
+        }
+    }
+
+    void set_shared_memory(bool on) override {
+        if (on == sharedMemory)
+            return;
+
+        sharedMemory = on;
+        networks.big.set_shared_memory(on);
+        networks.small.set_shared_memory(on);
+
+        // load() does nothing for the net that is loaded already
+        if (loadedBig)
+        {
+            NetworkBig big({EvalFileDefaultNameBig, "", ""}, EmbeddedNNUEType::BIG);
+            big.set_shared_memory(on);
+            big.load(loadedBig->first, loadedBig->second);
+            networks.big = std::move(big);
+        }
+        if (loadedSmall)
+        {
+            NetworkSmall small({EvalFileDefaultNameSmall, "", ""}, EmbeddedNNUEType::SMALL);
+            small.set_shared_memory(on);
+            small.load(loadedSmall->first, loadedSmall->second);
+            networks.small = std::move(small);
+        }
+    }
+
+    void verify(const std::function<void(std::string_view)>& f) const override {
+        networks.big.verify(EvalFileDefaultNameBig, f);
+        networks.small.verify(EvalFileDefaultNameSmall, f);
+    }
+
+    bool convert(const std::string& in, const std::string& out) const override {
+        // Fresh networks, their current file is the one loaded or none
+        NetworkBig big({EvalFileDefaultNameBig, "", ""}, EmbeddedNNUEType::BIG);
+        big.load("", in);
+        if (big.save_raw(out))
+            return true;
+
+        NetworkSmall small({EvalFileDefaultNameSmall, "", ""}, EmbeddedNNUEType::SMALL);
+        small.load("", in);
+        return small.save_raw(out);
+    }
+
+    std::unique_ptr<Backend> replicate() const override {
+        auto copy = std::make_unique<BackendImpl>(*this);
+        copy->networks.big.copy_mapping();
+        copy->networks.small.copy_mapping();
+        return copy;
+    }
+
+    std::unique_ptr<AccumulatorCaches> new_caches() const override {
+        return std::make_unique<AccumulatorCaches>(networks);
+    }
+
+    void clear(AccumulatorCaches& caches) const override { caches.clear(networks); }
+
+    NetworkOutput evaluate(EmbeddedNNUEType   type,
+                           const Position&    pos,
+                           AccumulatorStack&  accumulators,
+                           AccumulatorCaches& caches) const override {
+        return type == EmbeddedNNUEType::BIG
+               ? networks.big.evaluate(pos, accumulators, &caches.big)
+               : networks.small.evaluate(pos, accumulators, &caches.small);
+    }
+
+    void evaluate_batch(EmbeddedNNUEType                             type,
+                        std::size_t                                  n,
+                        const std::function<Position&(std::size_t)>& position,
+                        AccumulatorCaches&                           caches,
+                        NetworkOutput*                               output) const override {
+        if (type == EmbeddedNNUEType::BIG)
+            networks.big.evaluate_batch(n, position, &caches.big, output);
+        else
+            networks.small.evaluate_batch(n, position, &caches.small, output);
+    }
+
+    void bench(const std::vector<std::string>& fens, std::ostream& out) const override {
+        NNUE::bench(networks, fens, out);
+    }
+
+   private:
+    Networks networks;
+    bool     sharedMemory = false;
+
+    // Arguments of the last load() of each net
+    std::optional<std::pair<std::string, std::string>> loadedBig, loadedSmall;
+};
+
+}  // namespace
+}  // namespace NNUE_ARCH
+
+// One factory per instruction set, make_backend() in nnue_dispatch.cpp picks
+std::unique_ptr<Backend> NNUE_CONCAT(make_backend_, NNUE_ARCH)();
+std::unique_ptr<Backend> NNUE_CONCAT(make_backend_, NNUE_ARCH)() {
+    return std::make_unique<BackendImpl>();
+}
+
+}  // namespace Stockfish::Eval::NNUE
@@ -0,0 +1,116 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Instruction set independent interface to the networks
+
+#ifndef NNUE_BACKEND_H_INCLUDED
+#define NNUE_BACKEND_H_INCLUDED
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "../types.h"
+
+namespace Stockfish {
+class Position;
+}
+
+namespace Stockfish::Eval::NNUE {
+
+struct AccumulatorCaches;
+class AccumulatorStack;
+
+enum class EmbeddedNNUEType {
+    BIG,
+    SMALL,
+};
+
+using NetworkOutput = std::tuple<Value, Value>;
+
+// The big and the small network together with the code that evaluates them,
+// compiled for one instruction set. The engine only talks to the networks
+// through this class: with runtime dispatch (make dispatch=yes) the code is
+// compiled once per instruction set and make_backend() picks the fastest one
+// the CPU supports. The virtual calls happen once per evaluation, everything
+// below them (accumulator updates, layers) is resolved at compile time.
+class Backend {
+   public:
+    virtual ~Backend() = default;
+
+    // Name of the instruction set the code was compiled for
+    virtual const char* arch() const = 0;
+
+    virtual void load(EmbeddedNNUEType   type,
+                      const std::string& rootDirectory,
+                      const std::string& evalfilePath) = 0;
+    virtual void verify(const std::function<void(std::string_view)>&) const = 0;
+
+    // Whether the feature transformers of .nnue nets are shared with the other
+    // processes of the same user on the host through shared memory: they trust
+    // each other with the weights. The nets loaded so far are loaded again.
+    virtual void set_shared_memory(bool on) = 0;
+
+    // A copy of the networks for one NUMA node: all of it, mapped nets too,
+    // is written by the calling thread, and so placed on its node.
+    virtual std::unique_ptr<Backend> replicate() const = 0;
+
+    // Writes the big or small net in file 'in' as a raw net, which loads by
+    // mapping the file, see Network::save_raw(). Returns false if 'in' is
+    // neither or the output cannot be written. The loaded nets are not changed.
+    virtual bool convert(const std::string& in, const std::string& out) const = 0;
+
+    // The caches hold the biases of the loaded networks, they must be cleared
+    // with clear() after a load
+    virtual std::unique_ptr<AccumulatorCaches> new_caches() const              = 0;
+    virtual void                               clear(AccumulatorCaches&) const = 0;
+
+    virtual NetworkOutput evaluate(EmbeddedNNUEType   type,
+                                   const Position&    pos,
+                                   AccumulatorStack&  accumulators,
+                                   AccumulatorCaches& caches) const = 0;
+
+    // Evaluates n unrelated positions (offline labeling, no search): output[i]
+    // is what evaluate() returns for position(i). The callback may reuse one
+    // Position for all of them, its accumulator stack is refreshed from the
+    // caches. The dense layers run for many positions at once.
+    virtual void evaluate_batch(EmbeddedNNUEType                             type,
+                                std::size_t                                  n,
+                                const std::function<Position&(std::size_t)>& position,
+                                AccumulatorCaches&                           caches,
+                                NetworkOutput*                               output) const = 0;
+
+    // Times the parts of the evaluation on the positions of the FENs and on
+    // the positions one move away, and prints the results ('bench nnue'): ns
+    // per call of each stage and of the accumulator update per move type,
+    // with the IPC where the hardware counters are available
+    virtual void bench(const std::vector<std::string>& fens, std::ostream& out) const = 0;
+};
+
+// Networks with the default nets, using the code for the best instruction set
+// available
+std::unique_ptr<Backend> make_backend();
+
+}  // namespace Stockfish::Eval::NNUE
+
+#endif  // #ifndef NNUE_BACKEND_H_INCLUDED
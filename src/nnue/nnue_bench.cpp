@@ -0,0 +1,495 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmarks of the NNUE code ('bench nnue'), compiled with the code
+// they measure. Also included by the files in nnue/arch/ for runtime dispatch.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../perfcount.hpp"
+#include "../position.h"
+#include "network.h"
+#include "nnue_accumulator.h"
+
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Calls timed per stage and accumulator updates timed per move type, about
+constexpr std::uint64_t CallsPerStage  = 1000000;
+constexpr std::uint64_t UpdatesPerType = 1000000;
+
+// Calls in a row on the same position for the stages that do not change it,
+// so that reading the clock costs little next to the smallest layers
+constexpr int Repeats = 64;
+
+// Rounds of the update timing. An update is the difference of two timings,
+// the rounds tell how far that difference moves from run to run.
+constexpr int UpdateRounds = 7;
+
+// Cost of one operation
+struct Cost {
+    double ns           = 0;
+    double cycles       = 0;  // 0 without counters
+    double instructions = 0;
+
+    std::uint64_t ops    = 0;  // Operations measured
+    double        spread = 0;  // ns, of a difference between its rounds
+
+    Cost operator-(const Cost& o) const {
+        return {ns - o.ns, cycles - o.cycles, instructions - o.instructions, ops};
+    }
+};
+
+// Time, and cycles and instructions where the counters are available, of the
+// sections between start() and stop()
+class Meter {
+   public:
+    void start() {
+        counters.start();
+        begin = Clock::now();
+    }
+
+    void stop() {
+        elapsed += Clock::now() - begin;
+        counters.stop();
+    }
+
+    Cost cost(std::uint64_t ops) const {
+        const perfcount::Counts counts = counters.read();
+        const double            n      = double(std::max<std::uint64_t>(ops, 1));
+        return {std::chrono::duration<double, std::nano>(elapsed).count() / n, counts.cycles / n,
+                counts.instructions / n, ops};
+    }
+
+   private:
+    perfcount::Counters counters;
+    Clock::time_point   begin;
+    Clock::duration     elapsed{0};
+};
+
+// Keeps results the compiler would otherwise find unused
+volatile std::int64_t sink;
+
+// The bench positions have few promotions, these have many, with and without
+// captures, next to castling rights
+const char* const ExtraFens[] = {
+  "r3k2r/1P4P1/8/8/8/8/1p4p1/R3K2R w KQkq - 0 1",
+  "r3k2r/1P4P1/8/8/8/8/1p4p1/R3K2R b KQkq - 0 1",
+  "1n1qk2r/P1P2ppp/8/8/8/8/p1p2PPP/1N1QK2R w Kk - 0 1",
+};
+
+enum MoveType {
+    QUIET,
+    CAPTURE,
+    PROMOTION,
+    CAPTURE_PROMOTION,
+    CASTLING,
+    KING,       // Refreshes the side of the king
+    RECAPTURE,  // A move then the capture of the piece moved, two plies
+    MOVE_TYPE_NB
+};
+
+constexpr const char* MoveTypeNames[MOVE_TYPE_NB] = {
+  "quiet", "capture", "promotion", "capture+promotion", "castling", "king", "move+recapture"};
+
+// One or two plies from a root position
+struct Sample {
+    chess::Move first, second = chess::Move::NO_MOVE;
+};
+
+struct Root {
+    chess::Board        board;
+    std::vector<Sample> samples[MOVE_TYPE_NB];
+};
+
+MoveType move_type(const chess::Board& board, chess::Move move) {
+    const bool capture = board.isCapture(move);
+
+    if (move.typeOf() == chess::Move::CASTLING)
+        return CASTLING;
+    if (move.typeOf() == chess::Move::PROMOTION)
+        return capture ? CAPTURE_PROMOTION : PROMOTION;
+    if (board.at(move.from()).type() == chess::PieceType::KING)
+        return KING;
+    return capture ? CAPTURE : QUIET;
+}
+
+// The positions and all the positions one move away from them, with their
+// moves sorted by type
+std::vector<Root> make_roots(const std::vector<std::string>& fens) {
+    std::vector<std::string> all(fens);
+    all.insert(all.end(), std::begin(ExtraFens), std::end(ExtraFens));
+
+    std::vector<chess::Board> boards;
+    for (const auto& fen : all)
+    {
+        chess::Board board(fen);
+        boards.push_back(board);
+
+        chess::Movelist moves;
+        chess::movegen::legalmoves(moves, board);
+        for (const auto& move : moves)
+        {
+            board.makeMove(move);
+            boards.push_back(board);
+            board.unmakeMove(move);
+        }
+    }
+
+    std::vector<Root> roots;
+    for (auto& board : boards)
+    {
+        Root root{board, {}};
+
+        chess::Movelist moves;
+        chess::movegen::legalmoves(moves, board);
+        for (const auto& move : moves)
+        {
+            const MoveType type = move_type(board, move);
+            root.samples[type].push_back({move});
+
+            if (type != QUIET)
+                continue;
+
+            board.makeMove(move);
+            chess::Movelist replies;
+            chess::movegen::legalmoves(replies, board);
+            for (const auto& reply : replies)
+                if (reply.to() == move.to() && reply.typeOf() == chess::Move::NORMAL
+                    && board.at(reply.from()).type() != chess::PieceType::KING)
+                    root.samples[RECAPTURE].push_back({move, reply});
+            board.unmakeMove(move);
+        }
+        roots.push_back(std::move(root));
+    }
+    return roots;
+}
+
+// Cost per stage
+enum Stage {
+    ACTIVE_INDICES,  // Features of both sides, from the board
+    REFRESH,         // Accumulators of both sides, from the cache
+    TRANSFORM,       // Accumulators to the input of the layers
+    FIND_NNZ,        // Non-zero input blocks of fc_0, part of fc_0
+    FC_0,
+    AC_SQR_0,
+    AC_0,
+    FC_1,
+    AC_1,
+    FC_2,
+    EVALUATE,  // With the accumulators computed: transform, layers, psqt
+    STAGE_NB
+};
+
+constexpr const char* StageNames[STAGE_NB] = {
+  "active indices", "refresh (cache)", "transform", "find_nnz", "fc_0 (sparse)", "ac_sqr_0",
+  "ac_0",           "fc_1",            "ac_1",      "fc_2",     "evaluate"};
+
+// Cost of op(i) for each of n inputs, called Repeats times in a row on each.
+// setup(i) prepares input i and is not measured.
+template<typename Setup, typename Op>
+Cost time_calls(std::size_t n, int repeats, Setup&& setup, Op&& op) {
+    const std::uint64_t passes = std::max<std::uint64_t>(1, CallsPerStage / (n * repeats));
+    Meter               meter;
+
+    for (std::uint64_t pass = 0; pass < passes; ++pass)
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            setup(i);
+            meter.start();
+            for (int r = 0; r < repeats; ++r)
+                op(i);
+            meter.stop();
+        }
+
+    return meter.cost(passes * n * repeats);
+}
+
+template<typename Arch, typename Transformer>
+void time_stages(const Network<Arch, Transformer>&                            network,
+                 AccumulatorCaches::Cache<Arch::TransformedFeatureDimensions>& cache,
+                 const std::vector<Root>&                                     roots,
+                 Position&                                                    pos,
+                 Cost                                                         (&cost)[STAGE_NB]) {
+
+    using Buffer = typename Arch::Buffer;
+    struct alignas(CacheLineSize) Input {
+        TransformedFeatureType features[Transformer::BufferSize];
+    };
+
+    const auto&       ft = network.feature_transformer();
+    const std::size_t n  = roots.size();
+
+    // The input of every layer for every position, as evaluate() computes it
+    std::vector<Input>  inputs(n);
+    std::vector<Buffer> buffers(n);
+    std::vector<int>    buckets(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        pos.set(roots[i].board);
+        buckets[i] = (pos.count<ALL_PIECES>() - 1) / 4;
+        ft.transform(pos, pos.stack, &cache, inputs[i].features, buckets[i]);
+
+        const Arch& stack  = network.layer_stack(buckets[i]);
+        Buffer&     buffer = buffers[i];
+        stack.fc_0.propagate(inputs[i].features, buffer.fc_0_out);
+        stack.ac_sqr_0.propagate(buffer.fc_0_out, buffer.ac_sqr_0_out);
+        stack.ac_0.propagate(buffer.fc_0_out, buffer.ac_0_out);
+        std::memcpy(buffer.ac_sqr_0_out + Arch::FC_0_OUTPUTS, buffer.ac_0_out,
+                    Arch::FC_0_OUTPUTS * sizeof(typename decltype(stack.ac_0)::OutputType));
+        stack.fc_1.propagate(buffer.ac_sqr_0_out, buffer.fc_1_out);
+        stack.ac_1.propagate(buffer.fc_1_out, buffer.ac_1_out);
+        stack.fc_2.propagate(buffer.ac_1_out, buffer.fc_2_out);
+    }
+
+    auto set_position = [&](std::size_t i) { pos.set(roots[i].board); };
+    auto set_computed = [&](std::size_t i) {
+        pos.set(roots[i].board);
+        pos.stack.evaluate(pos, ft, cache);
+    };
+    auto none  = [](std::size_t) {};
+    auto layer = [&](std::size_t i) -> const Arch& { return network.layer_stack(buckets[i]); };
+
+    cost[ACTIVE_INDICES] = time_calls(n, Repeats, set_position, [&](std::size_t) {
+        FeatureSet::IndexList white, black;
+        FeatureSet::append_active_indices<WHITE>(pos, white);
+        FeatureSet::append_active_indices<BLACK>(pos, black);
+        std::int64_t sum = 0;
+        for (IndexType index : white)
+            sum += index;
+        for (IndexType index : black)
+            sum += index;
+        sink = sum;
+    });
+
+    // Once per position, a second refresh would find the cache up to date
+    cost[REFRESH] =
+      time_calls(n, 1, set_position, [&](std::size_t) { pos.stack.evaluate(pos, ft, cache); });
+
+    // Writes the same inputs again
+    cost[TRANSFORM] = time_calls(n, Repeats, set_computed, [&](std::size_t i) {
+        sink = ft.transform(pos, pos.stack, &cache, inputs[i].features, buckets[i]);
+    });
+
+#if (USE_SSSE3 | (USE_NEON >= 8))
+    constexpr IndexType ChunkSize = decltype(Arch::fc_0)::ChunkSize;
+    constexpr IndexType NumChunks =
+      ceil_to_multiple<IndexType>(Arch::TransformedFeatureDimensions, 8) / ChunkSize;
+    std::uint16_t nnz[NumChunks];
+    cost[FIND_NNZ] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        IndexType count;
+        Layers::find_nnz<NumChunks>(reinterpret_cast<const std::int32_t*>(inputs[i].features),
+                                    nnz, count);
+        sink = count;
+    });
+#endif
+
+    cost[FC_0] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        layer(i).fc_0.propagate(inputs[i].features, buffers[i].fc_0_out);
+    });
+    cost[AC_SQR_0] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        layer(i).ac_sqr_0.propagate(buffers[i].fc_0_out, buffers[i].ac_sqr_0_out);
+    });
+    cost[AC_0] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        layer(i).ac_0.propagate(buffers[i].fc_0_out, buffers[i].ac_0_out);
+    });
+    cost[FC_1] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        layer(i).fc_1.propagate(buffers[i].ac_sqr_0_out, buffers[i].fc_1_out);
+    });
+    cost[AC_1] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        layer(i).ac_1.propagate(buffers[i].fc_1_out, buffers[i].ac_1_out);
+    });
+    cost[FC_2] = time_calls(n, Repeats, none, [&](std::size_t i) {
+        layer(i).fc_2.propagate(buffers[i].ac_1_out, buffers[i].fc_2_out);
+    });
+
+    cost[EVALUATE] = time_calls(n, Repeats, set_computed, [&](std::size_t) {
+        const auto [psqt, positional] = network.evaluate(pos, pos.stack, &cache);
+        sink                          = psqt + positional;
+    });
+}
+
+// Cost per sample to compute the accumulators of both sides of the network
+// after the moves, without making and undoing them. Each root is run with and
+// without the update in turn, which one first alternating, so that both see
+// the same caches and clock speed, and the difference is taken per round.
+// The median of the rounds is the cost, their range its spread.
+template<typename Net, typename Cache>
+Cost time_updates(const Net&               network,
+                  Cache&                   cache,
+                  const std::vector<Root>& roots,
+                  Position&                pos,
+                  MoveType                 type) {
+
+    std::size_t count = 0;
+    for (const auto& root : roots)
+        count += root.samples[type].size();
+    if (!count)
+        return {};
+
+    const std::uint64_t passes =
+      std::max<std::uint64_t>(1, UpdatesPerType / (count * UpdateRounds));
+    const auto&                     ft = network.feature_transformer();
+    std::array<Cost, UpdateRounds> rounds;
+
+    for (int round = 0; round < UpdateRounds; ++round)
+    {
+        Meter meter[2];  // Without and with the update
+
+        for (std::uint64_t pass = 0; pass < passes; ++pass)
+            for (const auto& root : roots)
+            {
+                if (root.samples[type].empty())
+                    continue;
+
+                for (int i = 0; i < 2; ++i)
+                {
+                    const bool update = (i + pass) & 1;
+
+                    pos.set(root.board);
+                    pos.stack.evaluate(pos, ft, cache);
+
+                    meter[update].start();
+                    for (const auto& sample : root.samples[type])
+                    {
+                        pos.do_move(sample.first);
+                        if (sample.second != chess::Move::NO_MOVE)
+                            pos.do_move(sample.second);
+                        if (update)
+                            pos.stack.evaluate(pos, ft, cache);
+                        if (sample.second != chess::Move::NO_MOVE)
+                            pos.undo_move(sample.second);
+                        pos.undo_move(sample.first);
+                    }
+                    meter[update].stop();
+                }
+            }
+
+        rounds[round] = meter[1].cost(passes * count) - meter[0].cost(passes * count);
+    }
+
+    std::sort(rounds.begin(), rounds.end(),
+              [](const Cost& a, const Cost& b) { return a.ns < b.ns; });
+    Cost cost   = rounds[UpdateRounds / 2];
+    cost.spread = rounds.back().ns - rounds.front().ns;
+    return cost;
+}
+
+// ns and IPC columns of a cost, IPC "-" without counters. A difference that
+// is not larger than its spread is noise.
+void print_cost(char* line, std::size_t size, const Cost& cost) {
+    if (cost.ns <= cost.spread)
+        std::snprintf(line, size, " %9s %5s", "noise", "-");
+    else if (cost.cycles > 0 && cost.instructions > 0)
+        std::snprintf(line, size, " %9.1f %5.2f", cost.ns, cost.instructions / cost.cycles);
+    else
+        std::snprintf(line, size, " %9.1f %5s", cost.ns, "-");
+}
+
+void print_header(std::ostream& out, const char* first, const char* second) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-18s %8s %9s %5s %9s %5s\n", first, second, "big ns",
+                  "IPC", "small ns", "IPC");
+    out << line;
+}
+
+void print_row(std::ostream&  out,
+               const char*    name,
+               std::uint64_t  count,
+               const Cost&    big,
+               const Cost&    small) {
+    char line[128], column[64];
+    std::snprintf(line, sizeof(line), "%-18s %8llu", name, static_cast<unsigned long long>(count));
+    print_cost(column, sizeof(column), big);
+    std::strncat(line, column, sizeof(line) - std::strlen(line) - 1);
+    print_cost(column, sizeof(column), small);
+    std::strncat(line, column, sizeof(line) - std::strlen(line) - 1);
+    out << line << "\n";
+}
+
+void bench_stages(const Networks& networks, const std::vector<Root>& roots, std::ostream& out) {
+    auto caches = std::make_unique<AccumulatorCaches>(networks);
+    auto pos    = std::make_unique<Position>(chess::Board());
+    Cost big[STAGE_NB], small[STAGE_NB];
+
+    time_stages(networks.big, caches->big, roots, *pos, big);
+    time_stages(networks.small, caches->small, roots, *pos, small);
+
+    out << "Stages, per call, on " << roots.size() << " positions\n";
+    print_header(out, "stage", "calls");
+    for (int stage = 0; stage < STAGE_NB; ++stage)
+    {
+#if !(USE_SSSE3 | (USE_NEON >= 8))
+        if (stage == FIND_NNZ)
+            continue;
+#endif
+        print_row(out, StageNames[stage], big[stage].ops, big[stage], small[stage]);
+    }
+}
+
+void bench_updates(const Networks& networks, const std::vector<Root>& roots, std::ostream& out) {
+    auto caches = std::make_unique<AccumulatorCaches>(networks);
+    auto pos    = std::make_unique<Position>(chess::Board());
+
+    out << "Accumulator update, per move, both sides (moves made and undone not counted,\n"
+        << "noise: within the spread of " << UpdateRounds << " rounds)\n";
+    print_header(out, "move type", "moves");
+
+    for (int type = 0; type < MOVE_TYPE_NB; ++type)
+    {
+        std::size_t count = 0;
+        for (const auto& root : roots)
+            count += root.samples[type].size();
+
+        const MoveType t     = MoveType(type);
+        const Cost     big   = time_updates(networks.big, caches->big, roots, *pos, t);
+        const Cost     small = time_updates(networks.small, caches->small, roots, *pos, t);
+
+        print_row(out, MoveTypeNames[type], count, big, small);
+    }
+}
+
+}  // namespace
+
+void bench(const Networks& networks, const std::vector<std::string>& fens, std::ostream& out) {
+    const auto roots = make_roots(fens);
+
+    if (!perfcount::Counters().available())
+        out << "IPC: no hardware counters (perf_event_open), '-'\n";
+
+    bench_stages(networks, roots, out);
+    out << "\n";
+    bench_updates(networks, roots, out);
+    out.flush();
+}
+
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
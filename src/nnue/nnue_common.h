@@ -29,20 +29,14 @@
 #include <type_traits>
 #include "../misc.h"
 
-#if defined(USE_AVX2)
-    #include <immintrin.h>
-
-#elif defined(USE_SSE41)
-    #include <smmintrin.h>
-
-#elif defined(USE_SSSE3)
-    #include <tmmintrin.h>
-
-#elif defined(USE_SSE2)
-    #include <emmintrin.h>
-
-#elif defined(USE_NEON)
-    #include <arm_neon.h>
+// Everything below nnue/ that depends on the instruction set (simd.h, the
+// layers, the feature transformer, the networks and the accumulator updates)
+// lives in an inline namespace named after it. With runtime dispatch that code
+// is compiled once per instruction set, each copy in its own namespace, see
+// nnue_backend.h. The types and constants of this file, the accumulators and
+// the features are the same for all of them and stay outside.
+#ifndef NNUE_ARCH
+    #define NNUE_ARCH base
 #endif
 
 namespace Stockfish::Eval::NNUE {
@@ -65,18 +59,25 @@ constexpr std::size_t CacheLineSize = 64;
 constexpr const char        Leb128MagicString[]   = "COMPRESSED_LEB128";
 constexpr const std::size_t Leb128MagicStringSize = sizeof(Leb128MagicString) - 1;
 
-// SIMD width (in bytes)
-#if defined(USE_AVX2)
-constexpr std::size_t SimdWidth = 32;
+constexpr std::size_t MaxSimdWidth = 32;
 
-#elif defined(USE_SSE2)
-constexpr std::size_t SimdWidth = 16;
+// Number of input feature dimensions after conversion
+constexpr IndexType TransformedFeatureDimensionsBig = 3072;
+constexpr int       L2Big                           = 15;
+constexpr int       L3Big                           = 32;
 
-#elif defined(USE_NEON)
-constexpr std::size_t SimdWidth = 16;
-#endif
+constexpr IndexType TransformedFeatureDimensionsSmall = 128;
+constexpr int       L2Small                           = 15;
+constexpr int       L3Small                           = 32;
 
-constexpr std::size_t MaxSimdWidth = 32;
+constexpr IndexType PSQTBuckets = 8;
+constexpr IndexType LayerStacks = 8;
+
+// If vector instructions are enabled, we update and refresh the
+// accumulator tile by tile such that each tile fits in the CPU's
+// vector registers.
+static_assert(PSQTBuckets % 8 == 0,
+              "Per feature PSQT values cannot be processed at granularity lower than 8 at a time.");
 
 // Type of input feature after conversion
 using TransformedFeatureType = std::uint8_t;
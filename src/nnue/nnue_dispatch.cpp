@@ -0,0 +1,63 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2025 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Picks the backend, the only file that knows which copies of the NNUE code
+// are built
+
+#include <memory>
+
+#include "nnue_backend.h"
+
+namespace Stockfish::Eval::NNUE {
+
+// Defined by nnue_backend.cpp, make_backend_base() with the flags of ARCH and
+// with dispatch=yes the others by the files in nnue/arch/
+std::unique_ptr<Backend> make_backend_base();
+
+#if defined(USE_NNUE_DISPATCH)
+std::unique_ptr<Backend> make_backend_sse41();
+std::unique_ptr<Backend> make_backend_avx2();
+std::unique_ptr<Backend> make_backend_avxvnni();
+std::unique_ptr<Backend> make_backend_avx512();
+std::unique_ptr<Backend> make_backend_vnni512();
+#endif
+
+std::unique_ptr<Backend> make_backend() {
+#if defined(USE_NNUE_DISPATCH)
+    // cpu_supports() also checks that the OS saves the vector registers
+    __builtin_cpu_init();
+    bool avx2   = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi")
+             && __builtin_cpu_supports("popcnt");
+    bool avx512 = avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+
+    if (avx512 && __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512dq")
+        && __builtin_cpu_supports("avx512vl"))
+        return make_backend_vnni512();
+    if (avx512)
+        return make_backend_avx512();
+    if (avx2 && __builtin_cpu_supports("avxvnni"))
+        return make_backend_avxvnni();
+    if (avx2)
+        return make_backend_avx2();
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt"))
+        return make_backend_sse41();
+#endif
+    return make_backend_base();
+}
+
+}  // namespace Stockfish::Eval::NNUE
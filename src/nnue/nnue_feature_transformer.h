@@ -34,6 +34,7 @@
 #include "simd.h"
 
 namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
 
 // Returns the inverse of a permutation
 template<std::size_t Len>
@@ -132,6 +133,15 @@ class FeatureTransformer {
         permute<16>(weights, InversePackusEpi16Order);
     }
 
+    // Weights permuted with the order of another instruction set (a raw net
+    // converted by another build), to ours
+    void repermute_weights(const std::array<std::size_t, 8>& order) {
+        const auto inverse = invert_permutation(order);
+        permute<16>(biases, inverse);
+        permute<16>(weights, inverse);
+        permute_weights();
+    }
+
     inline void scale_weights(bool read) {
         for (IndexType j = 0; j < InputDimensions; ++j)
         {
@@ -307,6 +317,7 @@ class FeatureTransformer {
     alignas(CacheLineSize) PSQTWeightType psqtWeights[InputDimensions * PSQTBuckets];
 };
 
+}  // namespace NNUE_ARCH
 }  // namespace Stockfish::Eval::NNUE
 
 #endif  // #ifndef NNUE_FEATURE_TRANSFORMER_H_INCLUDED
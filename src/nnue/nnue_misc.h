@@ -31,6 +31,10 @@ class Position;
 
 namespace Eval::NNUE {
 
+struct AccumulatorCaches;
+
+inline namespace NNUE_ARCH {
+
 struct EvalFile {
     // Default net name, will use one of the EvalFileDefaultName* macros defined
     // in evaluate.h
@@ -51,10 +55,10 @@ struct NnueEvalTrace {
 };
 
 struct Networks;
-struct AccumulatorCaches;
 
 std::string trace(Position& pos, const Networks& networks, AccumulatorCaches& caches);
 
+}  // namespace NNUE_ARCH
 }  // namespace Stockfish::Eval::NNUE
 }  // namespace Stockfish
 
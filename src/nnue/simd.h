@@ -38,7 +38,21 @@
 #include "../types.h"
 #include "nnue_common.h"
 
-namespace Stockfish::Eval::NNUE::SIMD {
+namespace Stockfish::Eval::NNUE {
+inline namespace NNUE_ARCH {
+
+// SIMD width (in bytes)
+#if defined(USE_AVX2)
+constexpr std::size_t SimdWidth = 32;
+
+#elif defined(USE_SSE2)
+constexpr std::size_t SimdWidth = 16;
+
+#elif defined(USE_NEON)
+constexpr std::size_t SimdWidth = 16;
+#endif
+
+namespace SIMD {
 
 // If vector instructions are enabled, we update and refresh the
 // accumulator tile by tile such that each tile fits in the CPU's
@@ -413,6 +427,8 @@ class SIMDTiling {
     static_assert(PSQTBuckets % PsqtTileHeight == 0, "PsqtTileHeight must divide PSQTBuckets");
 #endif
 };
-}
+}  // namespace SIMD
+}  // namespace NNUE_ARCH
+}  // namespace Stockfish::Eval::NNUE
 
 #endif
@@ -0,0 +1,99 @@
+#include "numa.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    #include <sched.h>
+#endif
+
+namespace numa {
+namespace {
+
+// Parses the kernel's list format, "0-3,8,10-11". Empty if malformed.
+std::vector<int> parse_list(const std::string& list) {
+    std::vector<int> result;
+    const char*      p = list.c_str();
+    while (*p)
+    {
+        char* end;
+        long  first = std::strtol(p, &end, 10);
+        long  last  = first;
+        if (end == p || first < 0)
+            return {};
+        if (*end == '-')
+        {
+            p    = end + 1;
+            last = std::strtol(p, &end, 10);
+            if (end == p || last < first)
+                return {};
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+            result.push_back(int(cpu));
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return {};
+    }
+    return result;
+}
+
+std::string read_line(const std::string& path) {
+    std::ifstream in(path);
+    std::string   line;
+    std::getline(in, line);
+    return line;
+}
+}  // namespace
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+std::vector<std::vector<int>> nodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::vector<std::vector<int>> result;
+    for (int node : parse_list(read_line("/sys/devices/system/node/online")))
+    {
+        std::vector<int> cpus;
+        for (int cpu : parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node)
+                                            + "/cpulist")))
+            if (!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                cpus.push_back(cpu);
+        if (!cpus.empty())
+            result.push_back(cpus);
+    }
+
+    if (result.empty())
+        result.emplace_back();
+    return result;
+}
+
+bool bind_this_thread(const std::vector<int>& cpus) {
+    if (cpus.empty())
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+#else
+
+std::vector<std::vector<int>> nodes() { return {{}}; }
+bool                          bind_this_thread(const std::vector<int>&) { return false; }
+
+#endif
+
+void run_on(const std::vector<int>& cpus, const std::function<void()>& f) {
+    std::thread thread([&] {
+        bind_this_thread(cpus);
+        f();
+    });
+    thread.join();
+}
+}  // namespace numa
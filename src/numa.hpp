@@ -0,0 +1,21 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+// NUMA topology and thread placement, for the copies of the networks per
+// node (see search.cpp). Linux only: elsewhere there is a single node and
+// threads are not bound.
+namespace numa {
+
+// The CPUs this process may run on, grouped by node, from
+// /sys/devices/system/node. Nodes without such CPUs are left out. A single
+// node with no CPUs listed when the topology is unknown.
+std::vector<std::vector<int>> nodes();
+
+// Restricts the calling thread to the given CPUs, false if it cannot
+bool bind_this_thread(const std::vector<int>& cpus);
+
+// Runs f on a new thread bound to the given CPUs and waits for it. Memory that
+// f writes first is placed on their node by the kernel (first touch).
+void run_on(const std::vector<int>& cpus, const std::function<void()>& f);
+}  // namespace numa
@@ -0,0 +1,83 @@
+#include "perfcount.hpp"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    #include <cstring>
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace perfcount {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+int open_counter(std::uint64_t config, int group) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.disabled       = group < 0;  // The group starts and stops with its leader
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+
+    // This thread, on any CPU
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+}
+}  // namespace
+
+Counters::Counters() {
+    leader = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader < 0)
+        return;
+
+    member = open_counter(PERF_COUNT_HW_INSTRUCTIONS, leader);
+    if (member < 0)
+    {
+        close(leader);
+        leader = -1;
+        return;
+    }
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+}
+
+Counters::~Counters() {
+    if (member >= 0)
+        close(member);
+    if (leader >= 0)
+        close(leader);
+}
+
+void Counters::start() {
+    if (leader >= 0)
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void Counters::stop() {
+    if (leader >= 0)
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+Counts Counters::read() const {
+    // PERF_FORMAT_GROUP: the number of counters, then their values in the
+    // order they joined the group
+    std::uint64_t values[3];
+    if (leader < 0 || ::read(leader, values, sizeof(values)) != sizeof(values) || values[0] != 2)
+        return {};
+    return {values[1], values[2]};
+}
+
+#else
+
+Counters::Counters() {}
+Counters::~Counters() {}
+void   Counters::start() {}
+void   Counters::stop() {}
+Counts Counters::read() const { return {}; }
+
+#endif
+}  // namespace perfcount
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+
+// Hardware performance counters of the calling thread, for the benchmarks
+// ('bench nnue'). Linux only, and only where the kernel lets the process
+// count (see perf_event_paranoid; containers and virtual machines often have
+// no counters): elsewhere available() is false and the counts stay 0.
+namespace perfcount {
+
+struct Counts {
+    std::uint64_t cycles       = 0;
+    std::uint64_t instructions = 0;
+};
+
+class Counters {
+   public:
+    Counters();
+    ~Counters();
+
+    Counters(const Counters&)            = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    bool available() const { return leader >= 0; }
+
+    // Counting is off until start(), stop() pauses it. The counts of all the
+    // sections between start() and stop() add up.
+    void start();
+    void stop();
+
+    // Counts of the user space code of the thread, excluding the kernel
+    Counts read() const;
+
+   private:
+    int leader = -1;  // Cycles, the instructions are counted in its group
+    int member = -1;
+};
+}  // namespace perfcount
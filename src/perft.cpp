@@ -0,0 +1,145 @@
+#include "perft.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace perft {
+namespace {
+
+// Lockless table shared by the threads: an entry is only used when the check
+// word matches the data it was stored with, so a torn write is a miss.
+class Table {
+   public:
+    explicit Table(size_t mb) {
+        size_t count = std::max<size_t>(1, (mb << 20) / sizeof(Entry));
+        // Round down to a power of two for the index mask
+        size = size_t(1) << chess::Bitboard(count).msb();
+        entries.reset(new Entry[size]);
+    }
+
+    bool probe(uint64_t key, int depth, uint64_t& nodes) const {
+        const Entry& e     = entries[key & (size - 1)];
+        uint64_t     data  = e.data.load(std::memory_order_relaxed);
+        uint64_t     check = e.check.load(std::memory_order_relaxed);
+        if ((check ^ data) != key || int(data & 0xFF) != depth)
+            return false;
+        nodes = data >> 8;
+        return true;
+    }
+
+    void store(uint64_t key, int depth, uint64_t nodes) {
+        Entry&   e    = entries[key & (size - 1)];
+        uint64_t data = nodes << 8 | uint64_t(depth);
+        e.data.store(data, std::memory_order_relaxed);
+        e.check.store(key ^ data, std::memory_order_relaxed);
+    }
+
+   private:
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> data{0};  // Leaves << 8 | depth
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    size_t                   size = 0;
+};
+
+uint64_t perft_hashed(chess::Board& board, int depth, Table& table) {
+    if (depth <= 1)
+        return perft(board, depth);
+
+    uint64_t nodes = 0;
+    if (table.probe(board.hash(), depth, nodes))
+        return nodes;
+
+    chess::Movelist moves;
+    chess::movegen::legalmoves(moves, board);
+    for (const auto& mv : moves)
+    {
+        board.makeMove(mv);
+        nodes += perft_hashed(board, depth - 1, table);
+        board.unmakeMove(mv);
+    }
+    table.store(board.hash(), depth, nodes);
+    return nodes;
+}
+}  // namespace
+
+uint64_t perft(chess::Board& board, int depth) {
+    if (depth <= 0)
+        return 1;
+
+    chess::Movelist moves;
+    chess::movegen::legalmoves(moves, board);
+    if (depth == 1)
+        return moves.size();
+
+    uint64_t nodes = 0;
+    for (const auto& mv : moves)
+    {
+        board.makeMove(mv);
+        nodes += perft(board, depth - 1);
+        board.unmakeMove(mv);
+    }
+    return nodes;
+}
+
+uint64_t run(const chess::Board& board, const Options& opts, std::ostream& out) {
+    auto start = std::chrono::steady_clock::now();
+
+    chess::Movelist moves;
+    chess::movegen::legalmoves(moves, board);
+
+    std::unique_ptr<Table> table;
+    if (opts.hashMB > 0)
+        table = std::make_unique<Table>(opts.hashMB);
+
+    // The threads take the next unclaimed root move until none is left, the
+    // subtrees differ a lot in size.
+    std::vector<uint64_t> counts(moves.size(), 0);
+    std::atomic<int>      next{0};
+    auto                  work = [&] {
+        chess::Board b = board;
+        for (int i; (i = next.fetch_add(1, std::memory_order_relaxed)) < moves.size();)
+        {
+            b.makeMove(moves[i]);
+            counts[i] = table ? perft_hashed(b, opts.depth - 1, *table) : perft(b, opts.depth - 1);
+            b.unmakeMove(moves[i]);
+        }
+    };
+
+    uint64_t total = 0;
+    if (opts.depth <= 1)
+        // Bulk count, nothing to split
+        total = opts.depth <= 0 ? 1 : moves.size();
+    else
+    {
+        int                      n = std::clamp(opts.threads, 1, std::max(1, moves.size()));
+        std::vector<std::thread> helpers;
+        for (int t = 1; t < n; ++t)
+            helpers.emplace_back(work);
+        work();
+        for (auto& t : helpers)
+            t.join();
+        for (auto c : counts)
+            total += c;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (opts.divide && opts.depth >= 1)
+        for (int i = 0; i < moves.size(); ++i)
+            out << chess::uci::moveToUci(moves[i], board.chess960()) << ": "
+                << (opts.depth == 1 ? 1 : counts[i]) << "\n";
+
+    out << "===========================\n";
+    out << "Total time (ms) : " << static_cast<int>(elapsed.count() * 1000) << "\n";
+    out << "Nodes searched  : " << total << "\n";
+    out << "Nodes/second    : " << static_cast<uint64_t>(total / std::max(elapsed.count(), 1e-6))
+        << std::endl;
+    return total;
+}
+}  // namespace perft
@@ -0,0 +1,25 @@
+#pragma once
+#include "chess.hpp"
+#include <cstdint>
+#include <ostream>
+
+// Move generator validation and benchmark: counts the leaves of the legal
+// move tree ('go perft N'). Independent of the search, it does not touch the
+// search threads or the transposition table.
+namespace perft {
+
+struct Options {
+    int    depth   = 1;
+    bool   divide  = false;  // Also print the count below each root move
+    int    threads = 1;      // Root moves are split across this many threads
+    size_t hashMB  = 0;      // Perft hash table size, 0 disables it
+};
+
+// Leaves of the tree of the given depth, depth 1 moves are counted without
+// being made (bulk counting)
+uint64_t perft(chess::Board& board, int depth);
+
+// Runs perft on a copy of the board and prints the result with the nodes per
+// second. Returns the number of leaves.
+uint64_t run(const chess::Board& board, const Options& opts, std::ostream& out);
+}  // namespace perft
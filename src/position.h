@@ -21,27 +21,51 @@
 #include "chess.hpp"
 #include "types.h"
 #include "nnue/nnue_accumulator.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
 namespace Stockfish {
+// The part of the position that do_move() updates incrementally, one entry per
+// ply, so that undo_move() only has to step back to the previous entry. The
+// NNUE DirtyPiece of each ply lives in the AccumulatorStack, which is already
+// a per-ply stack of its own.
+struct StateInfo {
+    // Copied from the previous ply, then updated by the move
+    Stockfish::Value npm[Stockfish::COLOR_NB];  // non-pawn material for WHITE and BLACK
+    int8_t pieceCount[Stockfish::PIECE_NB];     // [make_piece(c, ALL_PIECES)] counts all pieces of c
+
+    // Recomputed after the move
+    Stockfish::Bitboard checkers;  // enemy pieces giving check to the side to move
+    Stockfish::Bitboard blockersForKing[Stockfish::COLOR_NB];  // pieces shielding the king of c from sliders
+    Stockfish::Bitboard checkSquares[Stockfish::PIECE_TYPE_NB];  // where a piece of the side to move gives check
+    Stockfish::Piece    captured;
+};
+
 class Position {
    public:
-    Position(const chess::Board& board) {
-        b      = board;
-        npm[1] = piece_value(chess::PieceType::KNIGHT)
-                 * b.pieces(chess::PieceType::KNIGHT, chess::Color::BLACK).count()
-               + piece_value(chess::PieceType::BISHOP)
-                   * b.pieces(chess::PieceType::BISHOP, chess::Color::BLACK).count()
-               + piece_value(chess::PieceType::ROOK)
-                   * b.pieces(chess::PieceType::ROOK, chess::Color::BLACK).count()
-               + piece_value(chess::PieceType::QUEEN)
-                   * b.pieces(chess::PieceType::QUEEN, chess::Color::BLACK).count();
-        npm[0] = piece_value(chess::PieceType::KNIGHT)
-                 * b.pieces(chess::PieceType::KNIGHT, chess::Color::WHITE).count()
-               + piece_value(chess::PieceType::BISHOP)
-                   * b.pieces(chess::PieceType::BISHOP, chess::Color::WHITE).count()
-               + piece_value(chess::PieceType::ROOK)
-                   * b.pieces(chess::PieceType::ROOK, chess::Color::WHITE).count()
-               + piece_value(chess::PieceType::QUEEN)
-                   * b.pieces(chess::PieceType::QUEEN, chess::Color::WHITE).count();
+    Position(const chess::Board& board) { set(board); }
+
+    // Reuses this Position (and its accumulator stack, which is large) for
+    // another root position
+    void set(const chess::Board& board) {
+        b  = board;
+        sp = 0;
+        stack.reset();
+
+        StateInfo& si = states[0];
+        si            = StateInfo{};
+        for (int c = 0; c < Stockfish::COLOR_NB; ++c)
+            for (int pt = Stockfish::PAWN; pt <= Stockfish::KING; ++pt)
+            {
+                auto n = b.pieces(chess::PieceType(static_cast<chess::PieceType::underlying>(pt - 1)),
+                                  chess::Color(static_cast<chess::Color::underlying>(c)))
+                           .count();
+                si.pieceCount[make_piece(Stockfish::Color(c), Stockfish::PieceType(pt))] = n;
+                si.pieceCount[make_piece(Stockfish::Color(c), Stockfish::ALL_PIECES)] += n;
+                si.npm[c] += n * piece_value(Stockfish::PieceType(pt));
+            }
+        si.captured = Stockfish::NO_PIECE;
+        set_check_info();
     }
     inline Stockfish::Bitboard pieces(Stockfish::Color c) const { return b.us(c).getBits(); }
     inline Stockfish::Bitboard pieces(Stockfish::Color c, Stockfish::PieceType pt) const {
@@ -67,25 +91,11 @@ class Position {
     inline Stockfish::Bitboard pieces() const { return b.occ().getBits(); }
     template<Stockfish::PieceType Pt>
     inline int count() const {
-        switch (Pt)
-        {
-        case Stockfish::ALL_PIECES :
-            return b.occ().count();
-        default :
-            return b.pieces(chess::PieceType(static_cast<chess::PieceType::underlying>(Pt - 1)))
-              .count();
-        }
+        return count<Pt>(Stockfish::WHITE) + count<Pt>(Stockfish::BLACK);
     }
     template<Stockfish::PieceType Pt>
     inline int count(Stockfish::Color c) const {
-        switch (Pt)
-        {
-        case Stockfish::ALL_PIECES :
-            return b.occ().count();
-        default :
-            return b.pieces(chess::PieceType(static_cast<chess::PieceType::underlying>(Pt - 1)), c)
-              .count();
-        }
+        return st().pieceCount[make_piece(c, Pt)];
     }
     template<Stockfish::PieceType Pt>
     inline Stockfish::Square square(Stockfish::Color c) const {
@@ -106,10 +116,31 @@ class Position {
     inline Stockfish::Piece piece_on(const Stockfish::Square sq) const {
         return to_engine_piece(b.at(sq).internal());
     }
-    inline Stockfish::Value non_pawn_material() const { return npm[0] + npm[1]; }
-    inline Stockfish::Value non_pawn_material(Stockfish::Color c) const { return npm[(int) c]; }
+    inline Stockfish::Value non_pawn_material() const { return st().npm[0] + st().npm[1]; }
+    inline Stockfish::Value non_pawn_material(Stockfish::Color c) const { return st().npm[(int) c]; }
     inline int              rule50_count() const { return b.halfMoveClock(); }
-    void                    do_move(chess::Move m) {
+
+    inline Stockfish::Bitboard checkers() const { return st().checkers; }
+    inline bool                in_check() const { return st().checkers; }
+    inline Stockfish::Bitboard blockers_for_king(Stockfish::Color c) const {
+        return st().blockersForKing[c];
+    }
+    inline Stockfish::Bitboard pinned(Stockfish::Color c) const {
+        return st().blockersForKing[c] & pieces(c);
+    }
+
+    // Normal moves are answered from the check squares and blockers of the
+    // current ply, the rare discovered checks and special moves by the board.
+    bool gives_check(chess::Move m) const {
+        Stockfish::Bitboard fromBB = 1ULL << m.from().index();
+        if (m.typeOf() != chess::Move::NORMAL
+            || (st().blockersForKing[~side_to_move()] & fromBB))
+            return b.givesCheck(m) != chess::CheckType::NO_CHECK;
+        return st().checkSquares[type_of(piece_on(Stockfish::Square(m.from().index())))]
+             & (1ULL << m.to().index());
+    }
+
+    void do_move(chess::Move m) {
         Stockfish::DirtyPiece dp;
         dp.pc                     = to_engine_piece(b.at(m.from()).internal());
         dp.from                   = (Stockfish::Square) m.from().index();
@@ -155,52 +186,137 @@ class Position {
             dp.add_sq = dp.to;
             dp.to = Stockfish::SQ_NONE;  // promotion moves are not allowed to have a to square
         }
-        // Non pawn material
+        // Material and piece counts, from the pieces already looked up above
+        StateInfo& next = push_state();
+        next.captured   = captured;
+        if (captured)
+        {
+            next.npm[them] -= piece_value(type_of(captured));
+            --next.pieceCount[captured];
+            --next.pieceCount[make_piece(them, Stockfish::ALL_PIECES)];
+        }
         if (m.typeOf() == m.PROMOTION)
         {
-            npm[(int) us] += piece_value(m.promotionType());
+            next.npm[us] += piece_value(type_of(dp.add_pc));
+            --next.pieceCount[dp.pc];
+            ++next.pieceCount[dp.add_pc];
         }
-        // en passant and PxP are handled in piece_value
-        if (b.isCapture(m))
-            npm[(int) them] -= piece_value(b.at<chess::PieceType>(m.to()));
 
-        b.makeMove(m);  // finally no
+        b.makeMove(m);
+        set_check_info();
         stack.push(dp);
-        //return dp;
     }
     void undo_move(chess::Move m) {
         b.unmakeMove(m);
-        Stockfish::Color us   = side_to_move();
-        Stockfish::Color them = ~side_to_move();
-        if (m.typeOf() == m.PROMOTION)
-        {
-            npm[(int) us] -= piece_value(m.promotionType());
-        }
-        // en passant and PxP are handled in piece_value
-        if (b.isCapture(m))
-            npm[(int) them] += piece_value(b.at<chess::PieceType>(m.to()));
+        --sp;
         stack.pop();
     }
-    void                                    do_null_move() { b.makeNullMove(); }
-    void                                    undo_null_move() { b.unmakeNullMove(); }
+    // Passes the move: the pieces and the accumulators stay, the check info
+    // is that of the other side
+    void do_null_move() {
+        push_state().captured = Stockfish::NO_PIECE;
+        b.makeNullMove();
+        set_check_info();
+    }
+    void undo_null_move() {
+        b.unmakeNullMove();
+        --sp;
+    }
     chess::Board                            b;  // exposure to generate legal moves
     Stockfish::Eval::NNUE::AccumulatorStack stack;
 
    private:
-    Stockfish::Value        npm[2] = {0, 0};  // non-pawn material for WHITE and BLACK
-    inline Stockfish::Value piece_value(chess::PieceType pt) {  // fast and static check
+    // An index rather than a pointer, so that a Position can be copied
+    StateInfo        states[Stockfish::MAX_PLY + 1];
+    int              sp = 0;
+    const StateInfo& st() const { return states[sp]; }
+
+    // The entry of the next ply, with the material and piece counts of the
+    // current one
+    StateInfo& push_state() {
+        assert(sp + 1 < int(std::size(states)));
+        const StateInfo& prev = states[sp];
+        StateInfo&       next = states[++sp];
+        std::copy(std::begin(prev.npm), std::end(prev.npm), next.npm);
+        std::copy(std::begin(prev.pieceCount), std::end(prev.pieceCount), next.pieceCount);
+        return next;
+    }
+
+    // Checkers, blockers and check squares of the current ply, after b has
+    // been updated
+    void set_check_info() {
+        using att     = chess::attacks;
+        using PT      = chess::PieceType;
+
+        StateInfo&         si   = states[sp];
+        const chess::Color us   = b.sideToMove();
+        const chess::Color them = ~us;
+        const auto         ksq  = b.kingSq(us);
+        const auto         eksq = b.kingSq(them);
+        const auto         occ  = b.occ();
+
+        si.checkers =
+          ((att::pawn(us, ksq) & b.pieces(PT::PAWN, them)) | (att::knight(ksq) & b.pieces(PT::KNIGHT, them))
+           | (att::bishop(ksq, occ) & (b.pieces(PT::BISHOP, them) | b.pieces(PT::QUEEN, them)))
+           | (att::rook(ksq, occ) & (b.pieces(PT::ROOK, them) | b.pieces(PT::QUEEN, them))))
+            .getBits();
+
+        si.blockersForKing[static_cast<int>(us)]   = slider_blockers(ksq, them);
+        si.blockersForKing[static_cast<int>(them)] = slider_blockers(eksq, us);
+
+        si.checkSquares[Stockfish::PAWN]   = att::pawn(them, eksq).getBits();
+        si.checkSquares[Stockfish::KNIGHT] = att::knight(eksq).getBits();
+        si.checkSquares[Stockfish::BISHOP] = att::bishop(eksq, occ).getBits();
+        si.checkSquares[Stockfish::ROOK]   = att::rook(eksq, occ).getBits();
+        si.checkSquares[Stockfish::QUEEN] =
+          si.checkSquares[Stockfish::BISHOP] | si.checkSquares[Stockfish::ROOK];
+        si.checkSquares[Stockfish::KING] = 0;
+    }
+
+    // Pieces of either color that are the only piece between the king on ksq
+    // and a slider of color c
+    Stockfish::Bitboard slider_blockers(chess::Square ksq, chess::Color c) const {
+        using att     = chess::attacks;
+        using PT      = chess::PieceType;
+
+        const chess::Bitboard queens = b.pieces(PT::QUEEN, c);
+        const chess::Bitboard kingBB = chess::Bitboard::fromSquare(ksq);
+        chess::Bitboard       blockers(0ULL);
+        for (bool diagonal : {false, true})
+        {
+            auto slider = [diagonal](chess::Square sq, chess::Bitboard occ) {
+                return diagonal ? att::bishop(sq, occ) : att::rook(sq, occ);
+            };
+            chess::Bitboard snipers =
+              slider(ksq, chess::Bitboard(0ULL))
+              & ((diagonal ? b.pieces(PT::BISHOP, c) : b.pieces(PT::ROOK, c)) | queens);
+            while (snipers)
+            {
+                chess::Square sniperSq = snipers.pop();
+                // The squares strictly between the king and the sniper
+                chess::Bitboard between =
+                  slider(ksq, chess::Bitboard::fromSquare(sniperSq)) & slider(sniperSq, kingBB);
+                between &= b.occ();
+                if (between.count() == 1)
+                    blockers |= between;
+            }
+        }
+        return blockers.getBits();
+    }
+
+    static Stockfish::Value piece_value(Stockfish::PieceType pt) {
         switch (pt)
         {
-        case (int) chess::PieceType::KNIGHT :
+        case Stockfish::KNIGHT :
             return Stockfish::KnightValue;
-        case (int) chess::PieceType::BISHOP :
+        case Stockfish::BISHOP :
             return Stockfish::BishopValue;
-        case (int) chess::PieceType::ROOK :
+        case Stockfish::ROOK :
             return Stockfish::RookValue;
-        case (int) chess::PieceType::QUEEN :
+        case Stockfish::QUEEN :
             return Stockfish::QueenValue;
         default :
-            return 0;  // includes king
+            return 0;  // pawns and kings are not non-pawn material
         }
     }
     inline Stockfish::Piece to_engine_piece(chess::Piece::underlying u) const {
@@ -1,21 +1,72 @@
 #include "search.h"
 #include "evaluate.h"
+#include "infosink.hpp"
+#include "numa.hpp"
+#include "ucioptions.hpp"
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <chrono>
 #include <iostream>
+#include <sstream>
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 namespace search {
 using namespace Stockfish;  // maybe....
 using Move = uint16_t;
 
-std::unique_ptr<Stockfish::Eval::NNUE::Networks>          nn;
-std::unique_ptr<Stockfish::Eval::NNUE::AccumulatorCaches> cache;
+std::unique_ptr<Stockfish::Eval::NNUE::Backend>           nn;
 TranspositionTable                                        tt;
 std::chrono::time_point<std::chrono::steady_clock> start;
 std::atomic<bool> stop_requested;
-int               seldepth = 0;
+std::atomic<State> state{State::IDLE};
+uint64_t          nodeLimit = 0;  // go nodes N, 0 if unlimited
+bool              timeEvals = false;  // Sum the time spent in Eval::evaluate(), see set_eval_timing()
+
+// NUMA: with the search threads on several nodes, each node gets a copy of
+// the networks and its threads are bound to its CPUs, see set_threads()
+bool                                                      numaReplication = true;
+std::vector<std::vector<int>>                             numaNodes;  // CPUs per node in use
+std::vector<std::unique_ptr<Stockfish::Eval::NNUE::Backend>> replicas;  // Per node, or none
+
+// Guards the state transitions, so that waiting for ponderhit/stop or for the
+// end of the search cannot miss a wakeup
+std::mutex              stateMutex;
+std::condition_variable stateCv;
+
+constexpr int IIR_MIN_DEPTH = 4;
+
+// Aspiration windows: start at this depth with +-ASPIRATION_DELTA around the
+// previous score of the PV line being searched, widening on failure.
+constexpr int   ASPIRATION_MIN_DEPTH = 4;
+constexpr Value ASPIRATION_DELTA     = 25;
+
+// A legal move at the root together with the information needed to rank it
+// across iterations and MultiPV lines.
+struct RootMove {
+    explicit RootMove(chess::Move m) :
+        pv(1, m.move()) {}
+    bool operator==(const chess::Move& m) const { return pv[0] == m.move(); }
+    bool operator<(const RootMove& m) const {  // Sort in descending order
+        if (m.score != score)
+            return m.score < score;
+        if (m.previousScore != previousScore)
+            return m.previousScore < previousScore;
+        // Among moves without a score, the ones with the biggest subtrees were
+        // the hardest to refute and are the most likely to become best
+        return m.nodes < nodes;
+    }
+
+    Value             score         = -VALUE_INFINITE;
+    Value             previousScore = -VALUE_INFINITE;
+    int               selDepth      = 0;
+    uint64_t          nodes         = 0;  // Nodes spent below this move, over all iterations
+    std::vector<Move> pv;
+};
 
 struct SearchStackEntry {
     std::unique_ptr<Move[]> pv;
@@ -25,6 +76,54 @@ struct SearchStackEntry {
         pv(std::make_unique<Move[]>(Stockfish::MAX_PLY)) {}
 };
 
+// The search state of one search thread. Threads run Lazy SMP: every worker
+// searches the same root position and they only share the transposition
+// table. The main worker (id 0) checks the clock, prints info lines and
+// decides the bestmove.
+class Worker {
+   public:
+    Worker(size_t id, size_t node);
+
+    void iterative_deepening(const chess::Board& board, const TimeControl& tc);
+
+    std::vector<RootMove> rootMoves;
+    std::vector<Move>     bestPv;  // PV of the last completed iteration
+    SearchStats           stats;
+
+    // Written only by the owning thread, with relaxed accesses: a locked
+    // increment of a counter shared by all threads costs more than the node.
+    // Other threads only read it, through nodes_searched().
+    std::atomic<uint64_t> nodes{0};
+
+   private:
+    uint64_t node_count() const { return nodes.load(std::memory_order_relaxed); }
+    void     count_node() { nodes.store(node_count() + 1, std::memory_order_relaxed); }
+
+    Value evaluate(Position& pos);
+    Value negamax(Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackEntry* ss);
+    Value qsearch(
+      Position& pos, Value alpha, Value beta, int ply, SearchStackEntry* ss, int qdepth = 0);
+    void print_pv(int depth, size_t multiPV) const;
+
+    size_t                                                    id;
+    size_t                                                    node;  // Index into replicas
+    const Stockfish::Eval::NNUE::Backend*                     net = nullptr;  // nn or the replica
+    std::unique_ptr<Stockfish::Eval::NNUE::AccumulatorCaches> cache;
+    std::unique_ptr<Position> rootPos;  // Kept across searches, set to each new root
+    std::vector<SearchStackEntry>                             searchStack;
+    size_t pvIdx    = 0;  // MultiPV line currently being searched
+    double bestMoveChanges = 0;  // New best moves of the first line at the root, for the time manager
+    int    seldepth = 0;
+    int    callsCnt = 0;  // nodes until the next clock check (main worker only)
+};
+
+Worker::Worker(size_t i, size_t n) :
+    id(i),
+    node(n),
+    cache(nn->new_caches()),
+    rootPos(std::make_unique<Position>(chess::Board())),
+    searchStack(MAX_PLY + 2) {}
+
 inline Value value_draw(size_t nodes) { return VALUE_DRAW - 1 + Value(nodes & 0x2); }
 inline Value value_to_tt(Value v, int ply) {
     return is_win(v) ? v + ply : is_loss(v) ? v - ply : v;
@@ -56,13 +155,28 @@ static void update_pv(Move* pv, Move move, const Move* childPv) {
         *pv++ = *childPv++;
     *pv = 0;
 }
-static Value qsearch(Position& pos, Value alpha, Value beta, int ply, SearchStackEntry* ss) {
+Value Worker::evaluate(Position& pos) {
+    if (!timeEvals)
+        return Stockfish::Eval::evaluate(*net, pos, pos.stack, *cache, 0);
+
+    auto  evalStart = std::chrono::steady_clock::now();
+    Value v         = Stockfish::Eval::evaluate(*net, pos, pos.stack, *cache, 0);
+    stats.evalTime += std::chrono::steady_clock::now() - evalStart;
+    return v;
+}
+
+// qdepth counts the quiescence plies below the main search (0 at the horizon)
+Value Worker::qsearch(
+  Position& pos, Value alpha, Value beta, int ply, SearchStackEntry* ss, int qdepth) {
     seldepth = std::max(seldepth, ply+1);
 	
+    if (ply >= MAX_PLY - 1)
+        return pos.in_check() ? VALUE_DRAW : evaluate(pos);
+
     Value stand_pat = -VALUE_INFINITE;
-    if (!pos.b.inCheck())
+    if (!pos.in_check())
     {
-        stand_pat = Stockfish::Eval::evaluate(*nn, pos, pos.stack, *cache, 0);
+        stand_pat = evaluate(pos);
         ss->eval  = stand_pat;
         if (stand_pat >= beta)
             return stand_pat;
@@ -73,12 +187,16 @@ static Value qsearch(Position& pos, Value alpha, Value beta, int ply, SearchStac
     chess::Movelist list, list2;
     chess::movegen::legalmoves(list, pos.b);
     if (list.size() == 0)
-        return pos.b.inCheck() ? mated_in(ply + 1) : value_draw(nodes.load());
+        return pos.in_check() ? mated_in(ply + 1) : value_draw(node_count());
     for (int i = 0; i < list.size(); ++i)
     {
         chess::Move mv = list[i];
-        if (pos.b.isCapture(mv) || pos.b.givesCheck(mv) != chess::CheckType::NO_CHECK
-            || mv.typeOf() == mv.PROMOTION)
+        // When in check every evasion is searched, otherwise a quiet king move
+        // escaping the check is missed and the position is scored as lost.
+        // Quiet checks are only tried at the first quiescence ply so that
+        // check/evasion sequences cannot recurse without bound.
+        if (pos.in_check() || pos.b.isCapture(mv) || mv.typeOf() == mv.PROMOTION
+            || (qdepth == 0 && pos.gives_check(mv)))
             list2.add(mv);
     }
     movepick::qOrderMoves(pos.b, list2);
@@ -86,9 +204,16 @@ static Value qsearch(Position& pos, Value alpha, Value beta, int ply, SearchStac
     for (int i = 0; i < list2.size(); ++i)
     {
         chess::Move mv = list2[i];
+        if (stop_requested)
+            break;
+        if (nodeLimit && node_count() >= nodeLimit)
+        {
+            stop_requested = true;
+            break;
+        }
         pos.do_move(mv);
-        ++nodes;
-        Value score = -qsearch(pos, -beta, -alpha, ply + 1, ss + 1);
+        count_node();
+        Value score = -qsearch(pos, -beta, -alpha, ply + 1, ss + 1, qdepth + 1);
         pos.undo_move(mv);
 
         if (score >= beta)
@@ -100,18 +225,52 @@ static Value qsearch(Position& pos, Value alpha, Value beta, int ply, SearchStac
     return alpha;
 }
 
-static Value
-negamax(Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackEntry* ss) {
+Value Worker::negamax(
+  Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackEntry* ss) {
     seldepth = std::max(seldepth, ply+1);
 	if (stop_requested) return VALUE_NONE;
-    if (pos.b.isRepetition(1) || pos.b.halfMoveClock() >= 99)
+    // The clock is not running while pondering, ponderhit switches to timed mode.
+    // The node limit is checked here against the total of all threads, every
+    // worker also checks its own count before each node.
+    if (id == 0 && --callsCnt <= 0)
+    {
+        callsCnt = 1024;
+        if ((nodeLimit && nodes_searched() >= nodeLimit)
+            || (state.load(std::memory_order_relaxed) != State::PONDERING
+                && timeman::check_time()))
+        {
+            stop_requested = true;
+            return VALUE_NONE;
+        }
+    }
+    if (ply > 0 && (pos.b.isRepetition(1) || pos.b.halfMoveClock() >= 99))
         return VALUE_DRAW;
 
+    // The side to move can repeat a position of the search tree with its next
+    // move, so it scores at least a draw.
+    if (ply > 0 && alpha < VALUE_DRAW && pos.b.hasUpcomingRepetition(ply))
+    {
+        alpha = VALUE_DRAW;
+        if (alpha >= beta)
+            return alpha;
+    }
+
+    // Mate distance pruning: even mating on the next move cannot improve on a
+    // shorter mate already found closer to the root, and being mated here cannot
+    // be worse than a longer forced mate elsewhere.
+    if (ply > 0)
+    {
+        alpha = std::max(mated_in(ply + 1), alpha);
+        beta  = std::min(mate_in(ply + 2), beta);
+        if (alpha >= beta)
+            return alpha;
+    }
+
     uint64_t key = pos.b.hash();
     ss->pv[0]    = 0;
 
     TTEntry* entry = tt.lookup(key);
-    if (entry && entry->depth >= depth)
+    if (ply > 0 && entry && entry->depth >= depth)
     {
         Value tt_score = value_from_tt(entry->score, ply, pos.b.halfMoveClock());
         if ((entry->flag == TTFlag::EXACT)
@@ -123,31 +282,80 @@ negamax(Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackE
     if (depth <= 0)
         return qsearch(pos, alpha, beta, ply, ss);
 
+    // Internal iterative reductions: without a TT move the ordering below is
+    // only SEE and history, so search this node shallower instead.
+    if (ply > 0 && depth >= IIR_MIN_DEPTH && (!entry || !entry->move))
+    {
+        --depth;
+        ++stats.iir;
+    }
+
     chess::Movelist list;
-    chess::movegen::legalmoves(list, pos.b);
-    if (list.empty())
-        return pos.b.inCheck() ? mated_in(ply + 1) : value_draw(nodes.load());
+    if (ply == 0)
+    {
+        // The root searches the persistent root move list in its current order,
+        // skipping the moves already used by earlier MultiPV lines
+        for (size_t i = pvIdx; i < rootMoves.size(); ++i)
+            list.add(chess::Move(rootMoves[i].pv[0]));
+    }
+    else
+    {
+        chess::movegen::legalmoves(list, pos.b);
+        if (list.empty())
+            return pos.in_check() ? mated_in(ply + 1) : value_draw(node_count());
 
-    chess::Move bestMove;
-    Value       best = -VALUE_INFINITE, orig_alpha = alpha;
+        movepick::orderMoves(pos.b, list, entry ? entry->move : chess::Move::NULL_MOVE, ply);
+    }
 
-    movepick::orderMoves(pos.b, list, entry ? entry->move : chess::Move::NULL_MOVE, ply);
+    chess::Move bestMove = chess::Move::NULL_MOVE;
+    Value       best = -VALUE_INFINITE, orig_alpha = alpha;
 
+    int moveCount = 0;
     for (int i = 0; i < list.size(); ++i)
     {
         chess::Move mv = list[i];
-        if (ply == 0){
+        // Checked before every node is counted, so that with one thread
+        // 'go nodes N' searches exactly N nodes
+        if (nodeLimit && node_count() >= nodeLimit)
+        {
+            stop_requested = true;
+            break;
+        }
+        ++moveCount;
+        if (ply == 0 && id == 0){
 			auto  end   = std::chrono::steady_clock::now();
 			auto  s = std::chrono::duration_cast<std::chrono::seconds>(end - start).count();
 			if (s>=1)
-            std::cout << "info currmove " << chess::uci::moveToUci(mv) << " currmovenum " << i + 1
-                      << std::endl;
+            infosink::post_currmove("info currmove " + chess::uci::moveToUci(mv) + " currmovenum "
+                                    + std::to_string(moveCount + pvIdx));
 		}
+        RootMove* rm =
+          ply == 0 ? &*std::find(rootMoves.begin() + pvIdx, rootMoves.end(), mv) : nullptr;
+        uint64_t nodesBefore = node_count();
         pos.do_move(mv);
-        ++nodes;
+        count_node();
         Value score = -negamax(pos, depth - 1, -beta, -alpha, ply + 1, ss + 1);
         pos.undo_move(mv);
+        if (rm)
+            rm->nodes += node_count() - nodesBefore;
         if (stop_requested) break;
+        if (rm)
+        {
+            // The first move and every new best move get an exact score (or a
+            // bound on fail high), the others are only known to be <= alpha.
+            if (moveCount == 1 || score > alpha)
+            {
+                if (moveCount > 1 && pvIdx == 0)
+                    ++bestMoveChanges;
+                rm->score    = score;
+                rm->selDepth = seldepth;
+                rm->pv.resize(1);
+                for (const Move* m = (ss + 1)->pv.get(); *m; ++m)
+                    rm->pv.push_back(*m);
+            }
+            else
+                rm->score = -VALUE_INFINITE;
+        }
         if (score > best)
         {
             best     = score;
@@ -159,7 +367,7 @@ negamax(Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackE
             alpha = score;
         if (score >= beta)
         {
-            if (!pos.b.isCapture(mv) && pos.b.givesCheck(mv) == chess::CheckType::NO_CHECK
+            if (!pos.b.isCapture(mv) && !pos.gives_check(mv)
                 && mv.typeOf() != mv.PROMOTION)
             {
                 movepick::updateHistoryHeuristic(mv, depth);
@@ -168,7 +376,8 @@ negamax(Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackE
             break;
         }
     }
-	if (!stop_requested){
+	// Secondary MultiPV lines exclude moves at the root, do not store them
+	if (!stop_requested && !(ply == 0 && pvIdx)){
 		TTFlag flag = (best >= beta)       ? TTFlag::LOWERBOUND
 					: (best <= orig_alpha) ? TTFlag::UPPERBOUND
 										   : TTFlag::EXACT;
@@ -178,72 +387,463 @@ negamax(Position& pos, int depth, Value alpha, Value beta, int ply, SearchStackE
     ss->eval = best;
     return best;
 }
-void run_search(const chess::Board& board, const TimeControl& tc) {
-	std::vector<SearchStackEntry> ss(MAX_PLY);
-    int                           rundepth = tc.depth ? tc.depth : 5;
-    Position pos(board);
-    std::vector<Move> pv(MAX_PLY);
-    seldepth                               = 0;
-    start = std::chrono::steady_clock::now();
-    for (int d = 1; d <= rundepth && !stop_requested; ++d)
-    {
-        cache->clear(*nn);
-        for (auto& s : ss)
+static void print_score(std::ostream& os, Value v) {
+    if (is_decisive(v))
+    {
+        int m = (v > 0 ? VALUE_MATE - v : -VALUE_MATE - v);
+        os << "mate " << (v > 0 ? (m + 1) / 2 : -(m + 1) / 2);
+    }
+    else
+    {
+        os << "cp " << v;
+    }
+}
+
+// Prints one info line per MultiPV slot, best line first
+void Worker::print_pv(int depth, size_t multiPV) const {
+    auto end   = std::chrono::steady_clock::now();
+    auto nanos = std::max<int64_t>(
+      1, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    uint64_t total = nodes_searched();
+
+    for (size_t i = 0; i < multiPV; ++i)
+    {
+        const RootMove& rm      = rootMoves[i];
+        bool            updated = rm.score != -VALUE_INFINITE;
+        if (!updated && depth == 1)
+            continue;
+
+        std::ostringstream ss;
+        ss << "info depth " << (updated ? depth : std::max(1, depth - 1)) << " seldepth "
+           << rm.selDepth << " multipv " << i + 1 << " score ";
+        print_score(ss, updated ? rm.score : rm.previousScore);
+        ss << " nodes " << total << " nps " << (total * 1000000000 / nanos);
+        ss << " time " << nanos / 1000000 << " hashfull " << tt.hashfull() << " pv";
+        for (Move m : rm.pv)
+            ss << " " << chess::uci::moveToUci(chess::Move(m));
+        infosink::post(ss.str());
+    }
+}
+
+// Returns the expected reply to bestMove: the second PV move or, if the PV was
+// cut short by a TT hit, the TT move of the position after bestMove.
+static Move ponder_move(chess::Board board, const std::vector<Move>& pv) {
+    if (pv.size() > 1)
+        return pv[1];
+    board.makeMove(chess::Move(pv[0]));
+    TTEntry* entry = tt.lookup(board.hash());
+    if (!entry || !entry->move)
+        return 0;
+    chess::Movelist list;
+    chess::movegen::legalmoves(list, board);
+    return std::find(list.begin(), list.end(), chess::Move(entry->move)) != list.end()
+           ? entry->move
+           : 0;
+}
+
+void Worker::iterative_deepening(const chess::Board& board, const TimeControl& tc) {
+    int       rundepth = tc.depth ? tc.depth : 5;
+    Position& pos      = *rootPos;
+    pos.set(board);
+    bestPv.clear();
+    seldepth = 0;
+    callsCnt = 0;
+    stats    = {};
+    pos.stack.stats = {};
+    net      = replicas.empty() ? nn.get() : replicas[node].get();
+
+    // Seed the root move order with the regular move ordering, later
+    // iterations reorder by score and subtree size. 'go searchmoves'
+    // restricts the root to the given moves, and is ignored if none of them
+    // is legal: an empty root means checkmate or stalemate to main_search().
+    chess::Movelist legal;
+    chess::movegen::legalmoves(legal, pos.b);
+    movepick::orderMoves(pos.b, legal, chess::Move::NULL_MOVE, 0);
+    rootMoves.clear();
+    for (const auto& mv : legal)
+        if (tc.searchmoves.empty()
+            || std::count(tc.searchmoves.begin(), tc.searchmoves.end(),
+                          chess::uci::moveToUci(mv)))
+            rootMoves.emplace_back(mv);
+    if (rootMoves.empty())
+        for (const auto& mv : legal)
+            rootMoves.emplace_back(mv);
+    if (rootMoves.empty())
+        return;
+    size_t multiPV = std::min<size_t>(UCIOptions::getInt("MultiPV"), rootMoves.size());
+    Value  lastScore = VALUE_NONE;  // Best score of the previous iteration
+    bestMoveChanges  = 0;
+
+    // Every other helper starts one ply deeper, so that the helpers do not
+    // all search the same iteration at the same time
+    for (int d = 1 + (id & 1); d <= rundepth && !stop_requested; ++d)
+    {
+        net->clear(*cache);
+        for (auto& s : searchStack)
         {
             std::fill(s.pv.get(), s.pv.get() + MAX_PLY, 0);
             s.eval = VALUE_NONE;
         }
+        for (auto& rm : rootMoves)
+            rm.previousScore = rm.score;
+
+        for (pvIdx = 0; pvIdx < multiPV && !stop_requested; ++pvIdx)
+        {
+            // Each line gets its own aspiration window around its previous score
+            Value prev  = rootMoves[pvIdx].previousScore;
+            Value delta = ASPIRATION_DELTA;
+            Value alpha = -VALUE_INFINITE, beta = VALUE_INFINITE;
+            if (d >= ASPIRATION_MIN_DEPTH && !is_decisive(prev))
+            {
+                alpha = std::max(prev - delta, -VALUE_INFINITE);
+                beta  = std::min(prev + delta, VALUE_INFINITE);
+            }
+
+            while (true)
+            {
+                pos.stack.reset();
+                seldepth = 0;
+                Value v  = negamax(pos, d, alpha, beta, 0, searchStack.data());
+
+                // Bring the best move of this line to the front, keeping the
+                // order of the moves that were not improved on (stable sort)
+                std::stable_sort(rootMoves.begin() + pvIdx, rootMoves.end());
+                if (stop_requested)
+                    break;
+
+                if (v <= alpha)
+                {
+                    beta  = (alpha + beta) / 2;
+                    alpha = std::max(v - delta, -VALUE_INFINITE);
+                }
+                else if (v >= beta)
+                    beta = std::min(v + delta, VALUE_INFINITE);
+                else
+                    break;
+                delta += delta / 2;
+            }
+
+            // Sort the lines searched so far so that they are printed ranked
+            std::stable_sort(rootMoves.begin(), rootMoves.begin() + pvIdx + 1);
+        }
+
+        if (id == 0)
+            print_pv(d, multiPV);
+		if (!stop_requested)
+			bestPv = rootMoves[0].pv;
+
+        // Clock games: spend the time where the position needs it. While
+        // pondering the clock is not ours yet, ponderhit decides.
+        if (id == 0 && !stop_requested && state != State::PONDERING)
+        {
+            timeman::IterationInfo info;
+            info.bestMoveChanges = bestMoveChanges;
+            info.evalDrop        = d > 1 ? lastScore - rootMoves[0].score : 0;
+            info.bestMoveEffort =
+              double(rootMoves[0].nodes) / std::max<uint64_t>(1, node_count());
+            if (timeman::stop_after_iteration(info))
+                break;
+        }
+        bestMoveChanges /= 2;
+        lastScore = rootMoves[0].score;
+        // go mate N: a mate in N moves or less has been proven
+        Value v = rootMoves[0].score;
+        if (tc.mate && !stop_requested && v >= VALUE_MATE_IN_MAX_PLY
+            && (VALUE_MATE - v + 1) / 2 <= tc.mate)
+            break;
+
+    }
 
-        pos.stack.reset();
-        Value v     = negamax(pos, d, -VALUE_INFINITE, VALUE_INFINITE, 0, ss.data());
-        auto  end   = std::chrono::steady_clock::now();
-        auto  nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    stats.nnue = pos.stack.stats;
 
-        std::cout << "info depth " << d << " seldepth " << seldepth << " score ";
-        if (is_decisive(v))
+    // Stopped before the first iteration finished: fall back to the best move so far
+    if (bestPv.empty())
+        bestPv = rootMoves[0].pv;
+}
+
+// ---------------------- Thread pool ---------------------------
+
+// A search thread sleeps in idle_loop() until it is given a job to run. A
+// thread given CPUs is bound to them.
+class SearchThread {
+   public:
+    SearchThread(size_t id, size_t node, std::vector<int> cpus) :
+        thread([this, id, node, cpus] { idle_loop(id, node, cpus); }) {
+        wait_for_job_finished();
+    }
+    ~SearchThread() {
+        // The job may still be returning to idle_loop(), which would otherwise
+        // clear the exit request below
+        wait_for_job_finished();
         {
-            int m = (v > 0 ? VALUE_MATE - v : -VALUE_MATE - v);
-            std::cout << "mate " << (v > 0 ? (m + 1) / 2 : -(m + 1) / 2);
+            std::lock_guard<std::mutex> lk(mutex);
+            exit = busy = true;
         }
-        else
+        cv.notify_all();
+        thread.join();
+    }
+
+    void run(std::function<void()> f) {
+        wait_for_job_finished();
         {
-			std::cout << "cp " << v;
+            std::lock_guard<std::mutex> lk(mutex);
+            job  = std::move(f);
+            busy = true;
         }
-        std::cout << " nodes " << nodes << " nps " << (nodes * 1000000000 / nanos);
-        std::cout << " time " << nanos / 1000000 << " hashfull " << tt.hashfull() << " pv ";
-        for (int j = 0; j < MAX_PLY && ss[0].pv[j]; ++j)
-            std::cout << chess::uci::moveToUci(chess::Move(ss[0].pv[j])) << " ";
-        std::cout << std::endl;
-		if (!stop_requested) {
-			for (int i = 0; i < MAX_PLY; ++i) {
-				pv[i] = ss[0].pv[i];
-			}
-		}
+        cv.notify_all();
+    }
 
+    void wait_for_job_finished() {
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&] { return !busy; });
     }
 
-    if (pv[0])
-        std::cout << "bestmove " << chess::uci::moveToUci(chess::Move(pv[0])) << std::endl;
+    std::unique_ptr<Worker> worker;
+
+   private:
+    // The worker is made here, after binding, so that first touch puts its
+    // memory (accumulators, caches) on the node of the thread
+    void idle_loop(size_t id, size_t node, const std::vector<int>& cpus) {
+        if (!cpus.empty())
+            numa::bind_this_thread(cpus);
+        worker = std::make_unique<Worker>(id, node);
+
+        while (true)
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            busy = false;
+            cv.notify_all();
+            cv.wait(lk, [&] { return busy; });
+            if (exit)
+                return;
+            auto f = std::move(job);
+            lk.unlock();
+            f();
+        }
+    }
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::function<void()>   job;
+    bool                    busy = true, exit = false;
+    std::thread             thread;  // Last, it starts running idle_loop() on construction
+};
+
+std::vector<std::unique_ptr<SearchThread>> threads;
+
+// Runs on the main search thread: starts the helpers, searches, waits for
+// 'stop'/'ponderhit' when UCI requires it, then prints the bestmove and
+// returns the pool to IDLE.
+static void main_search(const chess::Board& board, const TimeControl& tc) {
+    for (size_t i = 1; i < threads.size(); ++i)
+        threads[i]->run([i, board, tc] { threads[i]->worker->iterative_deepening(board, tc); });
+
+    Worker& main = *threads[0]->worker;
+    main.iterative_deepening(board, tc);
+
+    if (main.rootMoves.empty())
+    {
+        std::ostringstream ss;
+        ss << "info depth 0 score ";
+        print_score(ss, board.inCheck() ? -VALUE_MATE : VALUE_DRAW);
+        infosink::post(ss.str());
+    }
+
+    // UCI: bestmove must not be sent before 'stop' or 'ponderhit' while pondering
+    // or in infinite mode, even if the search finished on its own
+    {
+        std::unique_lock<std::mutex> lk(stateMutex);
+        stateCv.wait(lk, [&] {
+            return stop_requested || (state != State::PONDERING && !tc.infinite);
+        });
+    }
+
+    stop_requested = true;
+    for (size_t i = 1; i < threads.size(); ++i)
+        threads[i]->wait_for_job_finished();
+
+    if (main.rootMoves.empty())
+        infosink::post("bestmove 0000");
+    else
+    {
+        std::string bm = "bestmove " + chess::uci::moveToUci(chess::Move(main.bestPv[0]));
+        if (Move pm = ponder_move(board, main.bestPv))
+            bm += " ponder " + chess::uci::moveToUci(chess::Move(pm));
+        infosink::post(bm);
+    }
+    timeman::on_bestmove();
+    // IDLE means that the output of the search is complete
+    infosink::flush();
+
+    {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        state = State::IDLE;
+    }
+    stateCv.notify_all();
+}
+
+static int game_phase(const chess::Board& board) {
+    using PT = chess::PieceType;
+    return board.pieces(PT::KNIGHT).count() + board.pieces(PT::BISHOP).count()
+         + 2 * board.pieces(PT::ROOK).count() + 4 * board.pieces(PT::QUEEN).count();
+}
+
+void start_search(const chess::Board& board, const TimeControl& tc) {
+    wait_for_idle();
+    stop_requested = false;
+    for (auto& th : threads)
+        th->worker->nodes = 0;
+    nodeLimit = tc.nodes;
+    start          = std::chrono::steady_clock::now();
+    timeman::setLimits(tc, game_phase(board));
+    {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        state = tc.ponder ? State::PONDERING : State::SEARCHING;
+    }
+    threads[0]->run([board, tc] { main_search(board, tc); });
+}
+
+void stop() {
+    {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        stop_requested = true;
+    }
+    stateCv.notify_all();
+}
+
+void ponderhit() {
+    {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        if (state == State::PONDERING)
+            state = State::SEARCHING;
+    }
+    stateCv.notify_all();
+}
+
+void wait_for_idle() {
+    std::unique_lock<std::mutex> lk(stateMutex);
+    stateCv.wait(lk, [] { return state == State::IDLE; });
+}
+
+bool is_idle() { return state == State::IDLE; }
+
+void set_eval_timing(bool on) {
+    wait_for_idle();
+    timeEvals = on;
+}
+
+// Threads go to the nodes in turn, a node gets a copy of the networks only
+// if the threads use more than one node
+void update_replicas() {
+    replicas.clear();
+    if (numaNodes.size() < 2)
+        return;
+
+    replicas.resize(numaNodes.size());
+    for (size_t node = 0; node < numaNodes.size(); ++node)
+        numa::run_on(numaNodes[node], [node] { replicas[node] = nn->replicate(); });
+}
+
+void set_threads(size_t n) {
+    wait_for_idle();
+    threads.clear();  // Joins the old threads
+
+    numaNodes = numa::nodes();
+    if (!numaReplication || n < 2 || numaNodes.size() < 2)
+        numaNodes.clear();
+    else if (numaNodes.size() > n)
+        numaNodes.resize(n);
+    update_replicas();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t node = numaNodes.empty() ? 0 : i % numaNodes.size();
+        threads.push_back(std::make_unique<SearchThread>(
+          i, node, numaNodes.empty() ? std::vector<int>() : numaNodes[node]));
+    }
+}
+
+void set_numa_replication(bool on) {
+    wait_for_idle();
+    numaReplication = on;
+    if (!threads.empty())
+        set_threads(threads.size());
+}
+
+uint64_t nodes_searched() {
+    uint64_t total = 0;
+    for (const auto& th : threads)
+        total += th->worker->nodes.load(std::memory_order_relaxed);
+    return total;
+}
+
+void bench_nodes(std::ostream& out) {
+    constexpr uint64_t Counts = 20000000;  // per thread
+
+    // Each counter on its own cache line, as in the Workers
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> nodes{0};
+    };
+
+    // ns per count of each thread, all counting at the same time
+    auto ns_per_count = [&](size_t n, auto&& count) {
+        std::vector<std::thread> pool;
+        auto                     begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i)
+            pool.emplace_back(count, i);
+        for (auto& th : pool)
+            th.join();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin)
+                 .count()
+             / Counts;
+    };
+
+    const size_t n = std::max<size_t>(2, UCIOptions::getInt("Threads"));
+    out << "===========================\n";
+    out << "Counts          : " << Counts << " per thread\n";
+    for (size_t threadCount : {size_t(1), n})
+    {
+        std::vector<Counter> own(threadCount);
+        Counter              shared;
+
+        double perWorker = ns_per_count(threadCount, [&](size_t i) {
+            auto& c = own[i].nodes;
+            for (uint64_t k = 0; k < Counts; ++k)
+                c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        });
+        double sharedAtomic = ns_per_count(threadCount, [&](size_t) {
+            for (uint64_t k = 0; k < Counts; ++k)
+                shared.nodes.fetch_add(1);
+        });
+
+        out << "Threads         : " << threadCount << "\n";
+        out << "  per worker    : " << perWorker << " ns/count\n";
+        out << "  shared atomic : " << sharedAtomic << " ns/count\n";
+    }
+    out << "(threads beyond the number of cores share them, the shared atomic is then\n"
+        << " not contended)" << std::endl;
+}
+
+SearchStats collect_stats() {
+    SearchStats total;
+    for (const auto& th : threads)
+    {
+        total.iir += th->worker->stats.iir;
+        total.nnue += th->worker->stats.nnue;
+        total.evalTime += th->worker->stats.evalTime;
+    }
+    return total;
 }
 
 // ---------------------- Initialization ---------------------------
 template<bool init_nn>
 void init() {
     if constexpr (init_nn)
-    {
-        Stockfish::Eval::NNUE::NetworkBig nBig(
-          Stockfish::Eval::NNUE::EvalFile{EvalFileDefaultNameBig, "", EvalFileDefaultNameBig},
-          Stockfish::Eval::NNUE::EmbeddedNNUEType::BIG);
-        Stockfish::Eval::NNUE::NetworkSmall nSmall(
-          Stockfish::Eval::NNUE::EvalFile{EvalFileDefaultNameSmall, "", EvalFileDefaultNameSmall},
-          Stockfish::Eval::NNUE::EmbeddedNNUEType::SMALL);
-        nn = std::make_unique<Stockfish::Eval::NNUE::Networks>(std::move(nBig), std::move(nSmall));
-    }
+        nn = Stockfish::Eval::NNUE::make_backend();  // Picks the code for this CPU
     else
     {
-        nn->big.verify(EvalFileDefaultNameBig, onVerify);
-        nn->small.verify(EvalFileDefaultNameSmall, onVerify);
-        cache = std::make_unique<Stockfish::Eval::NNUE::AccumulatorCaches>(*nn);
+        nn->verify(onVerify);
+        onVerify(std::string("info string NNUE code: ") + nn->arch());
     }
 }
 
@@ -6,19 +6,52 @@
 #include "timeman.hpp"
 #include "tt.hpp"
 #include "types.h"
-#include "nnue/network.h"
+#include "nnue/nnue_backend.h"
 #include <atomic>
+#include <chrono>
+#include <ostream>
 namespace search {
-inline std::atomic<uint64_t> nodes{0};
+// Counters for search heuristics, reset at the start of every search
+struct SearchStats {
+    uint64_t iir = 0;  // internal iterative reductions (TT miss at depth >= IIR_MIN_DEPTH)
+    Stockfish::Eval::NNUE::AccumulatorStats nnue;  // feature transformer work
+    std::chrono::nanoseconds evalTime{0};  // in Eval::evaluate(), with set_eval_timing(true) only
+};
 struct SearchParams {
     TimeControl tc;
 };
+// State of the search thread pool. A search starts as SEARCHING or, for
+// 'go ponder', as PONDERING; 'ponderhit' moves PONDERING to SEARCHING and the
+// pool returns to IDLE once the bestmove has been printed.
+enum class State : uint8_t {
+    IDLE,
+    SEARCHING,
+    PONDERING
+};
 template<bool init_nn>
 void init();  // Called twice (one for UCIOptions NNUE paths and one for anything else
-void run_search(const chess::Board& board, const TimeControl& tc);
+
+// The search runs on its own threads, these return immediately
+void start_search(const chess::Board& board, const TimeControl& tc);
+void stop();
+void ponderhit();
+
+void        wait_for_idle();  // Blocks until the bestmove of the current search is printed
+bool        is_idle();
+void        set_eval_timing(bool on);  // Only while idle, costs two clock reads per evaluation
+void        set_threads(size_t n);  // Only while idle
+void        set_numa_replication(bool on);  // Only while idle, a copy of the networks per NUMA node
+void        update_replicas();              // Only while idle, after the networks changed
+SearchStats collect_stats();        // Summed over all threads, for the last search
+uint64_t    nodes_searched();       // Summed over all threads, for the current or last search
+
+// 'bench nodes': the cost of counting a node in a counter of each worker, as
+// the search does, and in one atomic shared by all threads. Only while idle.
+void bench_nodes(std::ostream& out);
+
 extern std::atomic<bool>                                stop_requested;
 extern TranspositionTable                               tt;
-extern std::unique_ptr<Stockfish::Eval::NNUE::Networks> nn;  // defer construction
+extern std::unique_ptr<Stockfish::Eval::NNUE::Backend>  nn;  // defer construction
 inline void onVerify(std::string_view sv) { std::cout << sv << std::endl; }
 }  // namespace search
 #endif  // CHESS_ENGINE_SEARCH_H
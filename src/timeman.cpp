@@ -2,7 +2,6 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
-#include <iostream>
 #include <limits>
 
 namespace timeman {
@@ -10,52 +9,82 @@ using namespace std::chrono;
 
 // Global state
 TimeControl                         current_tc;  // store the whole TimeControl struct globally
-time_point<high_resolution_clock>   start_time;
+time_point<steady_clock>            start_time;
 milliseconds                        inc         = milliseconds(0);
 milliseconds                        time_limit  = milliseconds(0);
+milliseconds                        optimum     = milliseconds(0);  // Budget per move, clock games only
 int                                 moves_to_go = 40;
-int                                 depth       = 0;
 std::array<int, Stockfish::MAX_PLY> times{};
 bool                                infinite = false;
-
-constexpr int    MIN_SAFE_BUFFER_MS  = 100;
-constexpr double BUFFER_PERCENTAGE   = 0.05;
+bool                                use_clock = false;
+int                                 move_overhead = 10;
+
+// Per game latency estimate: the clock of each 'go' is compared with what it
+// should be after our previous move, the difference was lost in transit (GUI,
+// network, OS scheduling). Averaged over the moves of the game.
+struct Latency {
+    bool         valid = false;  // last_left/last_inc/last_think describe our previous move
+    bool         white = true;
+    int          last_left = 0, last_inc = 0;
+    milliseconds last_think{0};
+    double       estimate = 0;  // ms
+} latency;
+
+constexpr int    MAX_LATENCY_SAMPLE  = 1000;  // Larger differences are clock changes, not latency
 constexpr int    MIN_PER_MOVE        = 400;
 constexpr int    MAX_PER_MOVE        = 3000;
 constexpr double PHASE_SCALE_OPENING = 0.7;
-constexpr double PHASE_SCALE_MIDDLE  = 1.0;
 constexpr double PHASE_SCALE_ENDGAME = 1.25;
-constexpr int    OPENING_DEPTH       = 5;
-constexpr int    MIDDLE_DEPTH        = 10;
-
-static double get_phase_scale(int current_depth) {
-    if (current_depth <= OPENING_DEPTH)
-        return PHASE_SCALE_OPENING;
-    else if (current_depth <= MIDDLE_DEPTH)
-        return PHASE_SCALE_MIDDLE;
-    else
-        return PHASE_SCALE_ENDGAME;
+constexpr double MAX_OPTIMUM_RATIO   = 3.0;   // Hard limit, in optima
+constexpr double MAX_TIME_LEFT_RATIO = 0.25;  // Hard limit, in remaining time
+
+// Interpolates between the opening and the endgame scale
+static double get_phase_scale(int phase) {
+    double p = std::clamp(phase, 0, PHASE_OPENING) / double(PHASE_OPENING);
+    return PHASE_SCALE_ENDGAME + (PHASE_SCALE_OPENING - PHASE_SCALE_ENDGAME) * p;
 }
 
-inline void reset_start_time() { start_time = high_resolution_clock::now(); }
-void        setLimits(const TimeControl& tc) {
+inline void reset_start_time() { start_time = steady_clock::now(); }
+
+// Time reserved per move for what happens outside of the search
+static int safety_margin() { return move_overhead + static_cast<int>(latency.estimate); }
+
+static void update_latency(const TimeControl& tc, bool prevValid, int time_left, int inc_ms) {
+    if (prevValid && latency.white == tc.white_to_move)
+    {
+        int expected = latency.last_left - static_cast<int>(latency.last_think.count())
+                     + latency.last_inc;
+        int lost = expected - time_left;
+        if (lost >= 0 && lost <= MAX_LATENCY_SAMPLE)
+            latency.estimate = (3 * latency.estimate + lost) / 4;
+    }
+    // While pondering the opponent's clock runs, the think time tells nothing
+    latency.valid     = !tc.ponder;
+    latency.white     = tc.white_to_move;
+    latency.last_left = time_left;
+    latency.last_inc  = inc_ms;
+}
+void        setLimits(const TimeControl& tc, int phase) {
     current_tc  = tc;
     infinite    = tc.infinite;
+    use_clock   = false;
+    time_limit  = milliseconds::max();
     moves_to_go = std::max(1, tc.movestogo);
-    depth       = tc.depth;
+
+    // Only two consecutive clock searches give a latency sample
+    bool prevValid = latency.valid;
+    latency.valid  = false;
 
     if (infinite && tc.depth > 0)
     {
         time_limit = milliseconds::max();
         inc        = milliseconds(0);
-        std::cout << "[TimeMan] Infinite or fixed depth mode.\n";
     }
     else if (tc.movetime >= 0 && tc.movetime < INFINITE_TIME)
     {
         // UCI: movetime overrides all other time settings
         time_limit = milliseconds(tc.movetime);
         inc        = milliseconds(0);
-        std::cout << "[TimeMan] Using fixed movetime: " << tc.movetime << " ms\n";
     }
     else
     {
@@ -65,20 +94,31 @@ void        setLimits(const TimeControl& tc) {
 
         if (time_left != INFINITE_TIME)
         {
+            update_latency(tc, prevValid, time_left, inc_ms);
+            // The margin is lost on every move until the next time control
+            time_left     = std::max(1, time_left - safety_margin() * std::min(moves_to_go, 10));
             int base_time = time_left / moves_to_go;
             int safe_time = base_time / 16 + inc_ms;
-            safe_time     = std::clamp(safe_time, MIN_PER_MOVE, MAX_PER_MOVE);
+            // The floor must not outgrow the share of a short clock (bullet)
+            safe_time = std::clamp(safe_time, std::min(MIN_PER_MOVE, base_time), MAX_PER_MOVE);
 
-            double scale = get_phase_scale(depth);
+            double scale = get_phase_scale(phase);
             safe_time    = static_cast<int>(safe_time * scale);
 
-            time_limit = milliseconds(safe_time);
-            inc        = milliseconds(inc_ms);
-
-            std::cout << "[TimeMan] Using clock. Left: " << time_left << " ms, inc: " << inc_ms
-                      << " ms, moves_to_go: " << moves_to_go << ", scaled: " << safe_time
-                      << " ms\n";
+            // The search normally stops after an iteration once the optimum
+            // is used up (see stop_after_iteration()), time_limit is the hard
+            // stop inside an iteration.
+            int max_time = std::min(static_cast<int>(safe_time * MAX_OPTIMUM_RATIO),
+                                    static_cast<int>(time_left * MAX_TIME_LEFT_RATIO));
+            max_time     = std::max(1, max_time);
+            optimum      = milliseconds(std::min(safe_time, max_time));
+            time_limit   = milliseconds(max_time);
+            inc          = milliseconds(inc_ms);
+            use_clock    = true;
         }
+        else
+            infinite = true;  // No clock (e.g. go depth N): only depth, nodes or mate limit the search
+
     }
 
     reset_start_time();
@@ -88,20 +128,26 @@ bool check_time() {
     if (infinite)
         return false;
 
-    int elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start_time).count();
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    return elapsed + safety_margin() >= time_limit.count();
+}
 
-    int dynamic_buffer =
-      std::max(MIN_SAFE_BUFFER_MS, static_cast<int>(time_limit.count() * BUFFER_PERCENTAGE));
+bool stop_after_iteration(const IterationInfo& info) {
+    if (!use_clock)
+        return false;
 
-    bool out_of_time = elapsed + dynamic_buffer >= time_limit.count();
+    // A falling score needs time to find something better, a rising one does not
+    double fallingEval = std::clamp(1.0 + info.evalDrop / 50.0, 0.7, 1.6);
+    double instability = std::min(1.0 + 1.5 * info.bestMoveChanges, 2.5);
+    // One move took nearly all the nodes: the other moves were refuted quickly
+    double effort = info.bestMoveEffort > 0.9 ? 0.6 : 1.0;
 
-    if (out_of_time)
-    {
-        std::cout << "[TimeMan] Out of time! Elapsed: " << elapsed
-                  << " ms, limit: " << time_limit.count() << " ms, buffer: " << dynamic_buffer
-                  << " ms" << std::endl;
-    }
-
-    return out_of_time;
+    double scaled  = optimum.count() * fallingEval * instability * effort;
+    double elapsed = duration<double, std::milli>(steady_clock::now() - start_time).count();
+    return elapsed >= std::min(scaled, static_cast<double>(time_limit.count()));
 }
+
+void on_bestmove() { latency.last_think = duration_cast<milliseconds>(steady_clock::now() - start_time); }
+
+void new_game() { latency = Latency{}; }
 }  // namespace timeman
@@ -1,6 +1,8 @@
 #pragma once
 #include "types.h"
 #include <chrono>
+#include <string>
+#include <vector>
 constexpr int INFINITE_TIME = 86400000;
 struct TimeControl {
     int     wtime         = INFINITE_TIME;
@@ -10,20 +12,48 @@ struct TimeControl {
     int     movestogo     = 40;
     int     movetime      = INFINITE_TIME;
     uint8_t depth         = Stockfish::MAX_PLY;
+    int     mate          = 0;  // go mate N: stop once a mate in N moves is found
+    uint64_t nodes        = 0;  // go nodes N: stop after exactly N nodes
+    std::vector<std::string> searchmoves;  // go searchmoves: restrict the root moves
     bool    infinite      = false;
+    bool    ponder        = false;  // go ponder: search without time limit until ponderhit
     bool    white_to_move = true;
 };
 
+// Game phase from the material on the board: knights and bishops count 1,
+// rooks 2 and queens 4, so the initial position is PHASE_OPENING.
+constexpr int PHASE_OPENING = 24;
+
 namespace timeman {
-extern std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
-extern std::chrono::milliseconds                                   time_buffer;
-extern std::chrono::milliseconds                                   inc;
-extern std::chrono::milliseconds                                   time_limit;
-extern int                                                         moves_to_go;
-extern bool                                                        infinite;
+extern std::chrono::time_point<std::chrono::steady_clock> start_time;
+extern std::chrono::milliseconds                          inc;
+extern std::chrono::milliseconds                          time_limit;
+extern int                                                moves_to_go;
+extern bool                                               infinite;
+extern int  move_overhead;  // "Move Overhead" option: time lost per move outside the engine, ms
+
+// What the last completed iteration tells about the position
+struct IterationInfo {
+    double bestMoveChanges = 0;  // Changes of the best root move, decayed over the iterations
+    int    evalDrop        = 0;  // Score of the previous iteration minus this one
+    double bestMoveEffort  = 0;  // Fraction of the root nodes spent below the best move
+};
 
 bool check_time();
 
-// Set time control limits using the TimeControl struct
-void setLimits(const TimeControl& tc);
+// Clock games: whether to stop instead of starting the next iteration. The
+// optimum time is stretched when the best move keeps changing or the score
+// falls, and cut when one root move takes nearly all the nodes.
+bool stop_after_iteration(const IterationInfo& info);
+
+// Set time control limits using the TimeControl struct, phase scales the
+// budget (more time once the material comes off)
+void setLimits(const TimeControl& tc, int phase = PHASE_OPENING);
+
+// Called when the bestmove is sent. Together with the clock of the next 'go'
+// this measures the time lost per move between the engine and the clock.
+void on_bestmove();
+
+// Forget the latency measured in the previous game
+void new_game();
 }  // namespace timeman
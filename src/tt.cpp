@@ -47,23 +47,18 @@ TTEntry* TranspositionTable::lookup(uint64_t hash) {
     }
     return nullptr;
 }
+// Per mille of used entries, from 1000 entries spread evenly over the table.
+// A full scan of a large table takes milliseconds and this is called for every
+// info line, including the final one after 'stop'.
 int TranspositionTable::hashfull() const {
-    size_t count = 0;
+    if (size == 0)
+        return 0;
 
-    // Unroll loop for speed (process 4 entries per iteration)
-    size_t i     = 0;
-    size_t limit = size & ~3ULL;  // align to multiple of 4
-    for (; i < limit; i += 4)
-    {
-        count += (table[i].hash != 0);
-        count += (table[i + 1].hash != 0);
-        count += (table[i + 2].hash != 0);
-        count += (table[i + 3].hash != 0);
-    }
-    for (; i < size; ++i)
-    {
-        count += (table[i].hash != 0);
-    }
+    const size_t sample = std::min<size_t>(size, 1000);
+    const size_t stride = size / sample;
+    size_t       count  = 0;
+    for (size_t i = 0; i < sample; ++i)
+        count += (table[i * stride].hash != 0);
 
-    return static_cast<int>((count * 1000) / size);
+    return static_cast<int>((count * 1000) / sample);
 }
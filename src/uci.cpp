@@ -1,11 +1,27 @@
 #include "uci.hpp"
+#include "evalbatch.hpp"
+#include "infosink.hpp"
+#include "perft.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <mutex>
 
 chess::Board board;
 std::mutex   board_mutex;
-// Thread handle
-static std::thread search_thread;
-static void        handleSetOption(const std::string& input) {
+
+// Options set while a search is running would race with it (e.g. a Hash
+// resize under the search threads), they are applied once the search is idle.
+// Only the command thread touches this queue.
+static std::vector<std::pair<std::string, std::string>> pending_options;
+
+static void apply_pending_options() {
+    for (const auto& [name, value] : pending_options)
+        UCIOptions::setOption(name, value);
+    pending_options.clear();
+}
+
+static void handleSetOption(const std::string& input) {
     std::istringstream iss(input);
     std::string        token, name, value;
     bool               reading_name = false, reading_value = false;
@@ -59,27 +75,55 @@ static void        handleSetOption(const std::string& input) {
         std::cerr << "info string Unknown option: " << name << "\n";
         return;
     }
+    if (!search::is_idle())
+    {
+        std::cerr << "info string option='" << name << "' deferred until the search is finished\n";
+        pending_options.emplace_back(name, value);
+        return;
+    }
     std::cerr << "info string option='" << name << "' value='" << value << "'\n";
     UCIOptions::setOption(name, value);
 }
+// The lines of the command thread go through the sink as well, behind the
+// lines of a running search. Commands that write a lot (bench, perft,
+// evalbatch) write directly once stop_search() has emptied the sink.
 static void handle_uci() {
-    std::cout << "id name cppchess_engine\n";
-    std::cout << "id author winapiadmin\n";
-    UCIOptions::printOptions();
-    std::cout << "uciok" << std::endl;
+    std::ostringstream out;
+    out << "id name cppchess_engine\n";
+    out << "id author winapiadmin\n";
+    UCIOptions::printOptions(out);
+    out << "uciok";
+    infosink::post(out.str());
 }
 
-inline void handle_isready() { std::cout << "readyok" << std::endl; }
+// Queued behind the info lines of a running search, so that it is never
+// written in the middle of one of them
+inline void handle_isready() { infosink::post("readyok"); }
+
+// Ends the running search, if any, and waits for its bestmove. Commands that
+// need the pool idle call this: waiting alone would block the command thread
+// for good behind 'go infinite' or 'go ponder'.
+static void stop_search() {
+    search::stop();
+    search::wait_for_idle();
+    infosink::flush();  // Lines of the command thread, e.g. readyok
+}
 
 inline void handle_quit() {
-    search::stop_requested = true;
-    if (search_thread.joinable())
-        search_thread.join();
+    stop_search();
+    infosink::shutdown();
 }
 
-inline void handle_stop() { search::stop_requested = true; }
+inline void handle_stop() { search::stop(); }
+
+// The opponent played the expected move: keep searching, now on our clock
+inline void handle_ponderhit() { search::ponderhit(); }
 
-inline void handle_display() { std::cout << board << std::endl; }
+inline void handle_display() {
+    std::ostringstream out;
+    out << board;
+    infosink::post(out.str());
+}
 
 static void handle_position(std::istringstream& iss) {
     std::string token;
@@ -147,25 +191,31 @@ static void handle_position(std::istringstream& iss) {
     }
 }
 
-void handle_bench() {
-    uint64_t                 nodes    = 0;
-    std::vector<std::string> fen_list = {
-      "r7/pp3kb1/7p/2nr4/4p3/7P/PP1N1PP1/R1B1K2R b KQ - 1 19",
-      "r1bqk2r/pppp1ppp/2n5/4p3/4P3/2N5/PPPP1PPP/R1BQK2R w KQkq - 0 1",
-      "rnbqkb1r/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
-      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1",
-      "8/pp3k2/7p/2nR4/4p3/7P/Pb3PP1/6K1 b - - 1 25",
-      "8/p4k2/1p1R3p/2n5/4p3/7P/Pb3PP1/6K1 b - - 1 26",
-      "8/p4k2/1p1R1b1p/2n5/4p3/7P/P4PP1/5K2 b - - 3 27",
-      "8/p3k3/1pR2b1p/2n5/4p3/7P/P4PP1/5K2 b - - 5 28",
-      "1R6/8/1p1knb1p/p7/4p3/7P/P3KPP1/8 b - - 3 32",
-      "3R4/8/1p1k3p/p7/3bp2P/6Pn/P3KP2/8 b - - 2 35",
-      "8/4R3/1p6/p5PP/3b4/2n2K2/P2kp3/8 w - - 1 46",
-      "rnbqkb1r/ppp1pppp/1n6/8/8/2N2N2/PPPP1PPP/R1BQKB1R w KQkq - 2 5",
-      "r2qr1k1/1ppb1pbp/np4p1/3Pp3/4N3/P2B1N1P/1PP2PP1/2RQR1K1 b - - 6 16",
-      "8/8/5k2/8/8/4Q1K1/PPP1PPPP/3R1BR1 w - - 67 88"};
+// Positions of bench, also used by 'bench stop' and 'bench eval'
+static const std::vector<std::string> bench_fens = {
+  "r7/pp3kb1/7p/2nr4/4p3/7P/PP1N1PP1/R1B1K2R b KQ - 1 19",
+  "r1bqk2r/pppp1ppp/2n5/4p3/4P3/2N5/PPPP1PPP/R1BQK2R w KQkq - 0 1",
+  "rnbqkb1r/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1",
+  "8/pp3k2/7p/2nR4/4p3/7P/Pb3PP1/6K1 b - - 1 25",
+  "8/p4k2/1p1R3p/2n5/4p3/7P/Pb3PP1/6K1 b - - 1 26",
+  "8/p4k2/1p1R1b1p/2n5/4p3/7P/P4PP1/5K2 b - - 3 27",
+  "8/p3k3/1pR2b1p/2n5/4p3/7P/P4PP1/5K2 b - - 5 28",
+  "1R6/8/1p1knb1p/p7/4p3/7P/P3KPP1/8 b - - 3 32",
+  "3R4/8/1p1k3p/p7/3bp2P/6Pn/P3KP2/8 b - - 2 35",
+  "8/4R3/1p6/p5PP/3b4/2n2K2/P2kp3/8 w - - 1 46",
+  "rnbqkb1r/ppp1pppp/1n6/8/8/2N2N2/PPPP1PPP/R1BQKB1R w KQkq - 2 5",
+  "r2qr1k1/1ppb1pbp/np4p1/3Pp3/4N3/P2B1N1P/1PP2PP1/2RQR1K1 b - - 6 16",
+  "8/8/5k2/8/8/4Q1K1/PPP1PPPP/3R1BR1 w - - 67 88"};
+
+void handle_bench(bool evalCost) {
+    uint64_t                  nodes    = 0;
+    uint64_t                  iir      = 0;
+    search::SearchStats       total;
+    const auto&               fen_list = bench_fens;
     std::vector<chess::Board> boards(fen_list.size());
-    auto                      start_time = std::chrono::high_resolution_clock::now();
+    search::set_eval_timing(evalCost);
+    auto                      start_time = std::chrono::steady_clock::now();
     for (size_t i = 0; i < fen_list.size(); ++i)
     {
         std::cout << "Position " << i + 1 << "/" << fen_list.size() << std::endl;
@@ -176,19 +226,137 @@ void handle_bench() {
         tc.infinite  = false;
         // All other fields remain at default (0 or -1)
 
-        search::run_search(boards[i], tc);
+        search::start_search(boards[i], tc);
+        search::wait_for_idle();
 
-        nodes += search::nodes;
+        nodes += search::nodes_searched();
+        search::SearchStats stats = search::collect_stats();
+        iir += stats.iir;
+        total.nnue += stats.nnue;
+        total.evalTime += stats.evalTime;
     }
-    auto                          end_time = std::chrono::high_resolution_clock::now();
+    auto                          end_time = std::chrono::steady_clock::now();
     std::chrono::duration<double> elapsed  = end_time - start_time;
+    search::set_eval_timing(false);
 
+    const auto& nnue = total.nnue;
     std::cout << "===========================\n";
     std::cout << "Total time (ms) : " << static_cast<int>(elapsed.count() * 1000) << "\n";
     std::cout << "Nodes searched  : " << nodes << "\n";
-    std::cout << "Nodes/second    : " << static_cast<uint64_t>(nodes / elapsed.count())
-              << std::endl;
+    std::cout << "Nodes/second    : " << static_cast<uint64_t>(nodes / elapsed.count()) << "\n";
+    std::cout << "IIR reductions  : " << iir << "\n";
+    // Accumulators are computed by evaluations only, moves whose position is
+    // never evaluated are undone untouched. Each network only computes its
+    // own accumulators, the big one for the positions it evaluates.
+    std::cout << "Moves made      : " << nnue.pushes << "\n";
+    std::cout << "Moves untouched : " << nnue.untouched << " (big net " << nnue.big.untouched
+              << ", small net " << nnue.small.untouched << ")\n";
+    std::cout << "Small net only  : " << nnue.small.evaluations - nnue.fallbacks << "\n";
+    std::cout << "Small then big  : " << nnue.fallbacks << "\n";
+    std::cout << "Big net only    : " << nnue.big.evaluations - nnue.fallbacks << "\n";
+    for (const auto& [label, net] :
+         {std::pair{"Big net acc.    : ", nnue.big}, std::pair{"Small net acc.  : ", nnue.small}})
+        std::cout << label << net.updates << " updates, " << net.refreshes << " refreshes ("
+                  << net.shortcuts << " instead of updates)\n";
+
+    if (evalCost)
+    {
+        // Clock reads included, about 20 ns per evaluation
+        double   evalSeconds = std::chrono::duration<double>(total.evalTime).count();
+        uint64_t evals = nnue.small.evaluations + nnue.big.evaluations - nnue.fallbacks;
+        std::cout << "Eval time (ms)  : " << static_cast<int>(evalSeconds * 1000) << " ("
+                  << static_cast<int>(100 * evalSeconds / elapsed.count()) << "% of the search)\n";
+        std::cout << "Eval ns/node    : "
+                  << static_cast<uint64_t>(evalSeconds * 1e9 / std::max<uint64_t>(nodes, 1)) << "\n";
+        std::cout << "Eval ns/call    : "
+                  << static_cast<uint64_t>(evalSeconds * 1e9 / std::max<uint64_t>(evals, 1)) << "\n";
+    }
+    std::cout << std::flush;
+}
+// bench stop: time from 'stop' to the bestmove written and flushed, on an
+// infinite search of each bench position stopped after a while. The search
+// threads must notice the stop, finish their node and print the final info
+// lines and the bestmove.
+static void handle_bench_stop() {
+    using namespace std::chrono;
+    constexpr milliseconds SearchTime{200};
+
+    std::vector<double> latencies;  // In ms
+    for (const auto& fen : bench_fens)
+    {
+        TimeControl tc;
+        tc.infinite = true;
+        tc.depth    = Stockfish::MAX_PLY;
+
+        search::start_search(chess::Board(fen), tc);
+        std::this_thread::sleep_for(SearchTime);
+
+        const auto start = steady_clock::now();
+        search::stop();
+        search::wait_for_idle();
+        latencies.push_back(duration<double, std::milli>(steady_clock::now() - start).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "===========================\n";
+    std::cout << "Searches        : " << latencies.size() << "\n";
+    std::cout << "Stop to bestmove: median " << latencies[latencies.size() / 2] << " ms, max "
+              << latencies.back() << " ms" << std::endl;
+}
+
+// go perft <depth> [divide] [hash <MB>] [threads <n>], threads default to the
+// Threads option. Runs on the command thread, like bench.
+static void handle_perft(std::istringstream& iss) {
+    perft::Options opts;
+    opts.threads = UCIOptions::getInt("Threads");
+    iss >> opts.depth;
+
+    std::string sub;
+    while (iss >> sub)
+    {
+        if (sub == "divide")
+            opts.divide = true;
+        else if (sub == "hash")
+            iss >> opts.hashMB;
+        else if (sub == "threads")
+            iss >> opts.threads;
+    }
+
+    stop_search();
+
+    chess::Board board_copy;
+    {
+        std::lock_guard<std::mutex> lock(board_mutex);
+        board_copy = board;
+    }
+    perft::run(board_copy, opts, std::cout);
+}
+
+// evalbatch <file>: static evaluation of every FEN of the file, see
+// evalbatch::run(). Runs on the command thread, like bench.
+static void handle_evalbatch(std::istringstream& iss) {
+    std::string path;
+    std::getline(iss >> std::ws, path);
+
+    std::ifstream in(path);
+    if (!in)
+    {
+        infosink::post("info string Cannot open " + path);
+        return;
+    }
+    stop_search();
+    evalbatch::run(in, std::cout);
+}
+
+// convertnet <in.nnue> <out>: writes the net as a raw net for the NNUE code
+// of this CPU, see Backend::convert(). Set it like any other net, it is then
+// mapped instead of read. Not on Windows yet, see MappedFile.
+bool convert_net(const std::string& in, const std::string& out) {
+    bool ok = search::nn->convert(in, out);
+    infosink::post("info string " + (ok ? "Converted " + in + " to " + out : "Cannot convert " + in));
+    return ok;
 }
+
 static void handle_go(std::istringstream& iss) {
     TimeControl tc;
     bool        white = (board.sideToMove() == chess::Color::WHITE);
@@ -196,7 +364,12 @@ static void handle_go(std::istringstream& iss) {
     int         depth = Stockfish::MAX_PLY;
     while (iss >> sub)
     {
-        if (sub == "depth")
+        if (sub == "perft")
+        {
+            handle_perft(iss);
+            return;
+        }
+        else if (sub == "depth")
             iss >> depth;
         else if (sub == "movetime")
             iss >> tc.movetime;
@@ -210,6 +383,18 @@ static void handle_go(std::istringstream& iss) {
             iss >> tc.binc;
         else if (sub == "movestogo")
             iss >> tc.movestogo;
+        else if (sub == "mate")
+            iss >> tc.mate;
+        else if (sub == "nodes")
+            iss >> tc.nodes;
+        else if (sub == "searchmoves")
+        {
+            // The remaining tokens are all moves
+            while (iss >> sub)
+                tc.searchmoves.push_back(sub);
+        }
+        else if (sub == "ponder")
+            tc.ponder = true;
         else if (sub == "infinite")
         {
             tc.infinite = true;
@@ -218,26 +403,25 @@ static void handle_go(std::istringstream& iss) {
     }
     tc.white_to_move = white;
     tc.depth         = depth;
-    if (search_thread.joinable())
-    {
-        search::stop_requested = true;
-        search_thread.join();
-    }
 
-    search::stop_requested = false;
+    // A new 'go' ends the previous search, if any
+    stop_search();
+    apply_pending_options();
 
     chess::Board board_copy;
     {
         std::lock_guard<std::mutex> lock(board_mutex);
         board_copy = board;
     }
-    search_thread = std::thread(search::run_search, board_copy, tc);  // keep joinable
+    search::start_search(board_copy, tc);
 }
 
 inline void handle_ucinewgame() {
+    stop_search();
     std::lock_guard<std::mutex> lock(board_mutex);
     board.setFen(chess::constants::STARTPOS);
     search::tt.clear();
+    timeman::new_game();
 }
 void uci_loop() {
     std::string line;
@@ -246,6 +430,8 @@ void uci_loop() {
         std::istringstream iss(line);
         std::string        token;
         iss >> token;
+        if (!pending_options.empty() && search::is_idle())
+            apply_pending_options();
         if (token == "ucinewgame")
             handle_ucinewgame();
         else if (token == "uci")
@@ -259,6 +445,8 @@ void uci_loop() {
         }
         else if (token == "stop")
             handle_stop();
+        else if (token == "ponderhit")
+            handle_ponderhit();
         else if (token == "setoption")
             handleSetOption(line);
         else if (token == "position")
@@ -268,10 +456,39 @@ void uci_loop() {
         else if (token == "d")
             handle_display();
         else if (token == "bench")
-            handle_bench();
+        {
+            stop_search();
+            std::string sub;
+            if (iss >> sub && sub == "eval")
+                evalbatch::bench(bench_fens, std::cout);
+            else if (sub == "numa")
+                evalbatch::bench_numa(bench_fens, std::cout);
+            else if (sub == "stop")
+                handle_bench_stop();
+            else if (sub == "infosink")
+                infosink::bench(std::cout);
+            else if (sub == "nodes")
+                search::bench_nodes(std::cout);
+            else if (sub == "nnue")
+            {
+                std::cout << "NNUE code: " << search::nn->arch() << "\n";
+                search::nn->bench(bench_fens, std::cout);
+            }
+            else
+                handle_bench(sub == "evalcost");
+        }
+        else if (token == "evalbatch")
+            handle_evalbatch(iss);
+        else if (token == "convertnet")
+        {
+            std::string in, out;
+            iss >> in >> out;
+            convert_net(in, out);
+        }
         else
             std::cerr << "[DEBUG] Unknown command: " << token << "\n";
     }
+    handle_quit();  // End of input
 }
 
 struct WinRateParams {
@@ -10,5 +10,6 @@
 #include <string>
 #include <thread>
 void uci_loop();
-void handle_bench();  // main()
+void handle_bench(bool evalCost = false);  // main(), 'bench evalcost' also times the evaluations
+bool convert_net(const std::string& in, const std::string& out);  // main(), 'convertnet' too
 int  to_cp(Stockfish::Value v, const Stockfish::Position& pos);
@@ -148,30 +148,30 @@ std::string getString(const std::string& name) {
     return "";
 }
 
-void printOptions() {
+void printOptions(std::ostream& out) {
     for (const auto& [name, opt] : options)
     {
-        std::cout << "option name " << name << " type ";
+        out << "option name " << name << " type ";
         switch (opt.type)
         {
         case Option::CHECK :
-            std::cout << "check default " << (std::get<int>(opt.value) ? "true" : "false") << "\n";
+            out << "check default " << (std::get<int>(opt.value) ? "true" : "false") << "\n";
             break;
         case Option::SPIN :
-            std::cout << "spin default " << std::get<int>(opt.value) << " min " << opt.min
+            out << "spin default " << std::get<int>(opt.value) << " min " << opt.min
                       << " max " << opt.max << "\n";
             break;
         case Option::STRING :
-            std::cout << "string default " << std::get<std::string>(opt.value) << "\n";
+            out << "string default " << std::get<std::string>(opt.value) << "\n";
             break;
         case Option::COMBO :
-            std::cout << "combo default " << std::get<std::string>(opt.value);
+            out << "combo default " << std::get<std::string>(opt.value);
             for (const auto& var : opt.vars)
-                std::cout << " var " << var;
-            std::cout << "\n";
+                out << " var " << var;
+            out << "\n";
             break;
         case Option::BUTTON :
-            std::cout << "button\n";
+            out << "button\n";
             break;
         }
     }
@@ -2,6 +2,7 @@
 
 #include <charconv>
 #include <functional>
+#include <ostream>
 #include <string>
 #include <unordered_map>
 #include <variant>
@@ -62,6 +63,6 @@ void setOption(const std::string& name, const std::string& val);
 int         getInt(const std::string& name);
 std::string getString(const std::string& name);
 
-void printOptions();
+void printOptions(std::ostream& out);
 
 }  // namespace UCIOptions